@@ -1,14 +1,35 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <functional>
+#include <iterator>
+#include <latch>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
 #include <optional>
-#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
 #include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -48,6 +69,7 @@ namespace pooriayousefi
     static const error invalid_params{-32602, "Invalid params", nullptr};
     static const error internal_error{-32603, "Internal error", nullptr};
     static const error request_cancelled{-32800, "Request cancelled", nullptr};
+    static const error request_timeout{-32001, "Request timed out", nullptr};
 
     // Helpers to detect message flavors
     inline bool is_request(const json &j)
@@ -169,16 +191,38 @@ namespace pooriayousefi
         return make_request(nullptr, method, params);
     }
 
-    inline json make_result(const json &id, const json &result)
+    // id and result are taken by value so callers that are done with them can move them in
+    inline json make_result(json id, json result)
     {
-        return json{{"jsonrpc", "2.0"}, {"id", id}, {"result", result}};
+        return json{{"jsonrpc", "2.0"}, {"id", std::move(id)}, {"result", std::move(result)}};
     }
 
-    inline json make_error(const json &id, const error &e)
+    inline json make_error(json id, const error &e)
     {
-        return json{{"jsonrpc", "2.0"}, {"id", id}, {"error", make_error_object(e)}};
+        return json{{"jsonrpc", "2.0"}, {"id", std::move(id)}, {"error", make_error_object(e)}};
     }
 
+    // A response that has not been rendered yet. An endpoint hands these to its response
+    // sender (endpoint::set_response_sender), which writes the envelope straight into its
+    // output with message_writer; to_json() builds the equivalent object for everyone else.
+    struct response_parts
+    {
+        json id;
+        json result;              // unused when err is set
+        std::optional<error> err;
+        // The id exactly as it appeared in the request, echoed by message_writer instead of
+        // serializing `id`. Points into the request text, so it is only set while that text
+        // is alive (a response sender must write it before returning).
+        std::string_view raw_id = {};
+
+        json to_json() &&
+        {
+            if (err)
+                return make_error(std::move(id), *err);
+            return make_result(std::move(id), std::move(result));
+        }
+    };
+
     // rpc_exception allows handlers to intentionally return a specific JSON-RPC error
     struct rpc_exception : std::runtime_error
     {
@@ -188,9 +232,322 @@ namespace pooriayousefi
 
     [[noreturn]] inline void throw_rpc_error(error e) { throw rpc_exception(std::move(e)); }
 
+    // --- Callable wrappers ---
+    template <typename Signature> class unique_function;
+    template <typename Signature> class function_ref;
+
+    namespace detail
+    {
+        template <typename T> struct is_unique_function : std::false_type
+        {
+        };
+        template <typename S> struct is_unique_function<unique_function<S>> : std::true_type
+        {
+        };
+
+        // Callables that have an empty state of their own
+        template <typename F> bool is_null_callable(const F &f)
+        {
+            if constexpr (std::is_pointer_v<F> || std::is_member_pointer_v<F> ||
+                          std::is_constructible_v<bool, const F &>)
+                return !f;
+            else
+                return false;
+        }
+    } // namespace detail
+
+    // Move-only type-erased callable. Callables up to inline_size bytes are stored in place
+    // (no allocation); invocation is a single indirect call through a stored function pointer.
+    template <typename R, typename... Args> class unique_function<R(Args...)>
+    {
+      public:
+        static constexpr std::size_t inline_size = 4 * sizeof(void *);
+
+        unique_function() noexcept = default;
+        unique_function(std::nullptr_t) noexcept {}
+
+        template <typename F, typename D = std::decay_t<F>,
+                  typename = std::enable_if_t<!detail::is_unique_function<D>::value &&
+                                              std::is_invocable_r_v<R, D &, Args...>>>
+        unique_function(F &&f)
+        {
+            if (detail::is_null_callable(f))
+                return;
+            if constexpr (stored_inline<D>())
+            {
+                ::new (static_cast<void *>(&storage_.buf)) D(std::forward<F>(f));
+                invoke_ = [](storage &s, Args &&...args) -> R
+                {
+                    return std::invoke(*std::launder(reinterpret_cast<D *>(&s.buf)),
+                                       std::forward<Args>(args)...);
+                };
+                manage_ = [](storage &dst, storage *src) noexcept
+                {
+                    D *from = std::launder(reinterpret_cast<D *>(&dst.buf));
+                    if (src)
+                    {
+                        D *other = std::launder(reinterpret_cast<D *>(&src->buf));
+                        ::new (static_cast<void *>(&dst.buf)) D(std::move(*other));
+                        other->~D();
+                    }
+                    else
+                    {
+                        from->~D();
+                    }
+                };
+            }
+            else
+            {
+                storage_.ptr = new D(std::forward<F>(f));
+                invoke_ = [](storage &s, Args &&...args) -> R
+                { return std::invoke(*static_cast<D *>(s.ptr), std::forward<Args>(args)...); };
+                manage_ = [](storage &dst, storage *src) noexcept
+                {
+                    if (src)
+                        dst.ptr = std::exchange(src->ptr, nullptr);
+                    else
+                        delete static_cast<D *>(dst.ptr);
+                };
+            }
+        }
+
+        unique_function(unique_function &&other) noexcept { take(other); }
+        unique_function &operator=(unique_function &&other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                take(other);
+            }
+            return *this;
+        }
+        unique_function &operator=(std::nullptr_t) noexcept
+        {
+            reset();
+            return *this;
+        }
+        unique_function(const unique_function &) = delete;
+        unique_function &operator=(const unique_function &) = delete;
+        ~unique_function() { reset(); }
+
+        explicit operator bool() const noexcept { return invoke_ != nullptr; }
+
+        R operator()(Args... args) const
+        {
+            if (!invoke_)
+                throw std::bad_function_call();
+            return invoke_(storage_, std::forward<Args>(args)...);
+        }
+
+      private:
+        union storage
+        {
+            alignas(std::max_align_t) unsigned char buf[inline_size];
+            void *ptr;
+        };
+        using invoke_fn = R (*)(storage &, Args &&...);
+        using manage_fn = void (*)(storage &dst, storage *src) noexcept; // move or destroy
+
+        template <typename D> static constexpr bool stored_inline()
+        {
+            return sizeof(D) <= inline_size && alignof(D) <= alignof(std::max_align_t) &&
+                   std::is_nothrow_move_constructible_v<D>;
+        }
+
+        void take(unique_function &other) noexcept
+        {
+            if (!other.invoke_)
+                return;
+            other.manage_(storage_, &other.storage_);
+            invoke_ = std::exchange(other.invoke_, nullptr);
+            manage_ = std::exchange(other.manage_, nullptr);
+        }
+
+        void reset() noexcept
+        {
+            if (invoke_)
+                manage_(storage_, nullptr);
+            invoke_ = nullptr;
+            manage_ = nullptr;
+        }
+
+        mutable storage storage_;
+        invoke_fn invoke_ = nullptr;
+        manage_fn manage_ = nullptr;
+    };
+
+    // Non-owning reference to a callable for call paths where the target outlives the call.
+    // Two pointers, never allocates; default-constructed refs are empty.
+    template <typename R, typename... Args> class function_ref<R(Args...)>
+    {
+      public:
+        function_ref() noexcept = default;
+
+        template <typename F, typename = std::enable_if_t<
+                                  !std::is_same_v<std::decay_t<F>, function_ref> &&
+                                  std::is_invocable_r_v<R, F &, Args...>>>
+        function_ref(F &&f) noexcept
+            : obj_(const_cast<void *>(static_cast<const void *>(std::addressof(f)))),
+              call_([](void *obj, Args &&...args) -> R
+                    {
+                        return std::invoke(*static_cast<std::remove_reference_t<F> *>(obj),
+                                           std::forward<Args>(args)...);
+                    })
+        {
+        }
+
+        explicit operator bool() const noexcept { return call_ != nullptr; }
+
+        R operator()(Args... args) const { return call_(obj_, std::forward<Args>(args)...); }
+
+      private:
+        void *obj_ = nullptr;
+        R (*call_)(void *, Args &&...) = nullptr;
+    };
+
     // --- Serialization/Deserialization Support ---
     namespace detail
     {
+        // Output adapter that only counts the bytes nlohmann's serializer would write
+        struct counting_output : nlohmann::detail::output_adapter_protocol<char>
+        {
+            std::size_t count = 0;
+            void write_character(char) override { ++count; }
+            void write_characters(const char *, std::size_t length) override { count += length; }
+        };
+
+        // Length of j.dump() without building the string
+        inline std::size_t serialized_size(const json &j)
+        {
+            auto out = std::make_shared<counting_output>();
+            nlohmann::detail::serializer<json>(out, ' ').dump(j, false, false, 0);
+            return out->count;
+        }
+
+        // Output adapter that appends to whichever string it is pointed at
+        struct string_output : nlohmann::detail::output_adapter_protocol<char>
+        {
+            std::string *target = nullptr;
+            void write_character(char c) override { target->push_back(c); }
+            void write_characters(const char *s, std::size_t length) override
+            {
+                target->append(s, length);
+            }
+        };
+
+        using json_serializer = nlohmann::detail::serializer<json>;
+        using json_output = nlohmann::detail::output_adapter_protocol<char>;
+
+        // Serialize a message with `s`, which writes to `out`
+        inline void write_message(json_serializer &s, json_output &, const json &msg)
+        {
+            s.dump(msg, false, false, 0);
+        }
+
+        // Error object text of the standard errors (without data), rendered on first use;
+        // empty for any other error
+        inline std::string_view standard_error_text(const error &e)
+        {
+            static const std::array<std::pair<const error *, std::string>, 7> table = []
+            {
+                std::array<std::pair<const error *, std::string>, 7> t{{
+                    {&parse_error, {}},
+                    {&invalid_request, {}},
+                    {&method_not_found, {}},
+                    {&invalid_params, {}},
+                    {&internal_error, {}},
+                    {&request_cancelled, {}},
+                    {&request_timeout, {}},
+                }};
+                for (auto &[err, text] : t)
+                    text = make_error_object(*err).dump();
+                return t;
+            }();
+            if (!e.data.is_null())
+                return {};
+            for (const auto &[err, text] : table)
+            {
+                if (err->code == e.code && err->message == e.message)
+                    return text;
+            }
+            return {};
+        }
+
+        // Error object written member by member: {"code":..,"message":..[,"data":..]}
+        inline void write_error_object(json_serializer &s, json_output &out, const error &e)
+        {
+            if (auto text = standard_error_text(e); !text.empty())
+            {
+                out.write_characters(text.data(), text.size());
+                return;
+            }
+            char code[16];
+            auto end = std::to_chars(code, code + sizeof(code), e.code).ptr;
+            out.write_characters(R"({"code":)", 8);
+            out.write_characters(code, static_cast<std::size_t>(end - code));
+            out.write_characters(R"(,"message":)", 11);
+            s.dump(json(e.message), false, false, 0);
+            if (!e.data.is_null())
+            {
+                out.write_characters(R"(,"data":)", 8);
+                s.dump(e.data, false, false, 0);
+            }
+            out.write_character('}');
+        }
+
+        // The envelope is assembled from fixed fragments around id and result; a raw id is
+        // copied as is and standard errors come pre-rendered, so no json is built
+        inline void write_message(json_serializer &s, json_output &out, const response_parts &r)
+        {
+            static constexpr std::string_view head = R"({"jsonrpc":"2.0","id":)";
+            out.write_characters(head.data(), head.size());
+            if (!r.raw_id.empty())
+                out.write_characters(r.raw_id.data(), r.raw_id.size());
+            else
+                s.dump(r.id, false, false, 0);
+            if (r.err)
+            {
+                out.write_characters(R"(,"error":)", 9);
+                write_error_object(s, out, *r.err);
+            }
+            else
+            {
+                out.write_characters(R"(,"result":)", 10);
+                s.dump(r.result, false, false, 0);
+            }
+            out.write_character('}');
+        }
+    } // namespace detail
+
+    // Serializes messages straight into a caller's buffer with the bundled serializer: no
+    // intermediate string from dump() and, for response_parts, no envelope object. Output is
+    // appended to `out`. Keep one per connection; not thread-safe.
+    class message_writer
+    {
+      public:
+        message_writer()
+            : output_(std::make_shared<detail::string_output>()),
+              serializer_(std::make_unique<detail::json_serializer>(output_, ' '))
+        {
+        }
+
+        void write(std::string &out, const json &msg) { write_to(out, msg); }
+        void write(std::string &out, const response_parts &r) { write_to(out, r); }
+
+      private:
+        template <typename M> void write_to(std::string &out, const M &msg)
+        {
+            output_->target = &out;
+            detail::write_message(*serializer_, *output_, msg);
+        }
+
+        std::shared_ptr<detail::string_output> output_;
+        std::unique_ptr<detail::json_serializer> serializer_; // not movable itself
+    };
+
+    namespace detail
+    {
+
         // Helper to deserialize params based on ParamsT type
         template <typename ParamsT> ParamsT deserialize_params(const json &params)
         {
@@ -271,11 +628,11 @@ namespace pooriayousefi
             }
         }
 
-        // Wrapper to create typed handler from function with C++ types
-        template <typename ParamsT, typename ResultT>
-        std::function<json(const json &)> make_typed_handler(std::function<ResultT(ParamsT)> fn)
+        // Wrapper to create typed handler from function with C++ types. The callable is captured
+        // as-is so the wrapper stays small enough for unique_function's inline storage.
+        template <typename ParamsT, typename ResultT, typename F> auto make_typed_handler(F fn)
         {
-            return [fn = std::move(fn)](const json &params) -> json
+            return [fn = std::move(fn)](const json &params) mutable -> json
             {
                 try
                 {
@@ -299,158 +656,2199 @@ namespace pooriayousefi
                     throw rpc_exception(e);
                 }
             };
-        }
+        }
+
+        // Wrapper for no-params handlers
+        template <typename ResultT, typename F> auto make_no_params_handler(F fn)
+        {
+            return [fn = std::move(fn)](const json &) mutable -> json
+            {
+                if constexpr (std::is_same_v<ResultT, void>)
+                {
+                    fn();
+                    return json(nullptr);
+                }
+                else
+                {
+                    ResultT result = fn();
+                    return serialize_result(std::move(result));
+                }
+            };
+        }
+    } // namespace detail
+
+    // Params handed to lazy handlers: a view of the request's raw params bytes that is only
+    // parsed on first access. Views into the input buffer are valid for the duration of the
+    // handler call; copy raw() into a string to keep it.
+    class lazy_params
+    {
+      public:
+        lazy_params() = default;
+        explicit lazy_params(std::string_view raw) : raw_(raw), present_(true) {}
+        explicit lazy_params(const json &parsed) : parsed_(&parsed), present_(!parsed.is_null())
+        {
+        }
+
+        lazy_params(const lazy_params &other) { assign(other); }
+        lazy_params(lazy_params &&other) noexcept { assign(std::move(other)); }
+        lazy_params &operator=(const lazy_params &other)
+        {
+            if (this != &other)
+                assign(other);
+            return *this;
+        }
+        lazy_params &operator=(lazy_params &&other) noexcept
+        {
+            if (this != &other)
+                assign(std::move(other));
+            return *this;
+        }
+
+        // True if the request carried a params member
+        bool has_value() const { return present_; }
+        // True once a parsed value is available without further work
+        bool is_parsed() const { return parsed_ != nullptr; }
+
+        // Raw JSON text of params (empty if absent); serialized on demand if only a parsed
+        // value is available
+        std::string_view raw() const
+        {
+            if (raw_.data() == nullptr && parsed_ && present_)
+            {
+                dumped_ = parsed_->dump();
+                raw_ = dumped_;
+            }
+            return raw_;
+        }
+
+        // Parsed params (null if absent)
+        const json &get() const
+        {
+            if (!parsed_)
+            {
+                if (present_)
+                    owned_ = json::parse(raw_.begin(), raw_.end());
+                parsed_ = &owned_;
+            }
+            return *parsed_;
+        }
+
+        // Parse and convert to T with the same rules as typed handlers
+        template <typename T> T as() const
+        {
+            try
+            {
+                return detail::deserialize_params<T>(get());
+            }
+            catch (const json::exception &ex)
+            {
+                error e = invalid_params;
+                e.data = json{{"what", ex.what()}};
+                throw rpc_exception(e);
+            }
+        }
+
+      private:
+        // A copy refers to its own parsed value and serialization, never to the source's
+        template <typename L> void assign(L &&other)
+        {
+            const bool owns_parsed = other.parsed_ == &other.owned_;
+            raw_ = other.raw_;
+            parsed_ = owns_parsed ? &owned_ : other.parsed_;
+            present_ = other.present_;
+            owned_ = std::forward<L>(other).owned_;
+            dumped_ = std::forward<L>(other).dumped_;
+            if (!dumped_.empty()) // raw() serialized into dumped_
+                raw_ = dumped_;
+        }
+
+        mutable std::string_view raw_;
+        mutable const json *parsed_ = nullptr;
+        mutable json owned_;
+        mutable std::string dumped_;
+        bool present_ = false;
+    };
+
+    // --- Envelope scanning (SAX) ---
+    namespace detail
+    {
+        // Little-endian 64-bit load that also works during constant evaluation
+        constexpr std::uint64_t load_word(const char *p) noexcept
+        {
+            if consteval
+            {
+                std::uint64_t w = 0;
+                for (int i = 0; i < 8; ++i)
+                    w |= std::uint64_t(static_cast<unsigned char>(p[i])) << (8 * i);
+                return w;
+            }
+            else
+            {
+                std::uint64_t w;
+                std::memcpy(&w, p, 8);
+                if constexpr (std::endian::native == std::endian::big)
+                    w = std::byteswap(w);
+                return w;
+            }
+        }
+
+        // Seeded word-at-a-time hash for method names; constexpr so compile-time routing
+        // tables agree with runtime lookups
+        constexpr std::uint64_t hash_name(std::string_view s, std::uint64_t salt) noexcept
+        {
+            std::uint64_t h = (salt + 1) * 0x9E3779B97F4A7C15ull ^ s.size();
+            const char *p = s.data();
+            std::size_t n = s.size();
+            for (; n >= 8; p += 8, n -= 8)
+                h = std::rotl((h ^ load_word(p)) * 0xFF51AFD7ED558CCDull, 31);
+            if (n)
+            {
+                // Tail: re-read the last word when possible to avoid a variable-size copy
+                std::uint64_t w = 0;
+                if (s.size() >= 8)
+                    w = load_word(s.data() + s.size() - 8);
+                else
+                    for (std::size_t i = 0; i < n; ++i)
+                        w |= std::uint64_t(static_cast<unsigned char>(p[i])) << (8 * i);
+                h = std::rotl((h ^ w) * 0xFF51AFD7ED558CCDull, 31);
+            }
+            h ^= h >> 32;
+            h *= 0xC4CEB9FE1A85EC53ull;
+            return h ^ (h >> 29);
+        }
+
+        // Transparent hash so string-keyed maps can be probed with a string_view
+        struct string_hash
+        {
+            using is_transparent = void;
+            std::size_t operator()(std::string_view s) const noexcept
+            {
+                return static_cast<std::size_t>(hash_name(s, 0));
+            }
+        };
+
+        // Collision-free lookup table over a fixed set of names (hash and displace). Each name
+        // is hashed once; its bucket's displacement picks a slot no other name occupies, so a
+        // lookup is one hash, one table probe and one compare against a copy of the name kept
+        // in a contiguous arena.
+        class perfect_hash_table
+        {
+          public:
+            using entry = std::pair<std::string_view, std::uint32_t>;
+
+            void build(const std::vector<entry> &keys)
+            {
+                const std::size_t n = keys.size();
+                const std::size_t cap = n ? std::bit_ceil(n + n / 4 + 1) : 0;
+                slots_.assign(cap, slot{});
+                mask_ = cap ? cap - 1 : 0;
+                disp_.assign(n ? std::bit_ceil((n + 3) / 4) : 0, 0);
+                arena_.clear();
+                if (n == 0)
+                    return;
+                for (salt_ = 0;; ++salt_)
+                {
+                    if (try_build(keys))
+                        return;
+                }
+            }
+
+            std::optional<std::uint32_t> find(std::string_view key) const
+            {
+                if (slots_.empty())
+                    return std::nullopt;
+                const std::uint64_t h = hash_name(key, salt_);
+                const slot &s = slots_[place(h, disp_[h & (disp_.size() - 1)])];
+                if (s.hash == h && s.len == key.size() &&
+                    std::memcmp(arena_.data() + s.offset, key.data(), key.size()) == 0)
+                    return s.value;
+                return std::nullopt;
+            }
+
+            std::size_t size() const { return slots_.size(); }
+
+          private:
+            struct slot
+            {
+                std::uint64_t hash = 0;
+                std::uint32_t offset = 0;
+                std::uint32_t len = ~0u; // never matches an unused slot
+                std::uint32_t value = 0;
+            };
+
+            std::size_t place(std::uint64_t h, std::uint32_t d) const
+            {
+                // Low bits chose the bucket; the high half gives each key its own base and odd
+                // step, so displacements move bucket members independently
+                const std::uint64_t base = h >> 20;
+                const std::uint64_t step = (h >> 40) | 1;
+                return static_cast<std::size_t>((base + d * step) & mask_);
+            }
+
+            bool try_build(const std::vector<entry> &keys)
+            {
+                const std::size_t n = keys.size();
+                std::vector<std::uint64_t> hashes(n);
+                for (std::size_t i = 0; i < n; ++i)
+                    hashes[i] = hash_name(keys[i].first, salt_);
+                {
+                    auto sorted = hashes;
+                    std::sort(sorted.begin(), sorted.end());
+                    if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+                        return false; // full-width collision: retry with another salt
+                }
+
+                std::vector<std::vector<std::size_t>> buckets(disp_.size());
+                for (std::size_t i = 0; i < n; ++i)
+                    buckets[hashes[i] & (disp_.size() - 1)].push_back(i);
+                std::vector<std::size_t> order(buckets.size());
+                std::iota(order.begin(), order.end(), 0);
+                std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+                                 { return buckets[a].size() > buckets[b].size(); });
+
+                std::vector<bool> used(slots_.size());
+                std::vector<std::size_t> taken;
+                for (std::size_t b : order)
+                {
+                    const auto &members = buckets[b];
+                    if (members.empty())
+                        break;
+                    bool placed = false;
+                    for (std::uint32_t d = 0; d < (1u << 16) && !placed; ++d)
+                    {
+                        taken.clear();
+                        placed = true;
+                        for (std::size_t i : members)
+                        {
+                            std::size_t at = place(hashes[i], d);
+                            if (used[at] ||
+                                std::find(taken.begin(), taken.end(), at) != taken.end())
+                            {
+                                placed = false;
+                                break;
+                            }
+                            taken.push_back(at);
+                        }
+                        if (placed)
+                        {
+                            disp_[b] = d;
+                            for (std::size_t at : taken)
+                                used[at] = true;
+                        }
+                    }
+                    if (!placed)
+                        return false;
+                }
+
+                // All buckets placed: materialize slots and the name arena
+                std::fill(slots_.begin(), slots_.end(), slot{});
+                arena_.clear();
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    const auto &[name, value] = keys[i];
+                    std::size_t at = place(hashes[i], disp_[hashes[i] & (disp_.size() - 1)]);
+                    slots_[at] = slot{hashes[i], static_cast<std::uint32_t>(arena_.size()),
+                                      static_cast<std::uint32_t>(name.size()), value};
+                    arena_.append(name);
+                }
+                return true;
+            }
+
+            std::uint64_t salt_ = 0;
+            std::uint64_t mask_ = 0;
+            std::vector<std::uint32_t> disp_;
+            std::vector<slot> slots_;
+            std::string arena_;
+        };
+
+        // Input iterator over a byte range that publishes how far the parser has read, so SAX
+        // callbacks can map events back to offsets in the original buffer.
+        class tracking_iterator
+        {
+          public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = char;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const char *;
+            using reference = const char &;
+
+            tracking_iterator(const char *p, const char **cursor) : p_(p), cursor_(cursor) {}
+
+            reference operator*() const { return *p_; }
+            tracking_iterator &operator++()
+            {
+                *cursor_ = ++p_;
+                return *this;
+            }
+            tracking_iterator operator++(int)
+            {
+                auto tmp = *this;
+                ++*this;
+                return tmp;
+            }
+            bool operator==(const tracking_iterator &o) const { return p_ == o.p_; }
+            bool operator!=(const tracking_iterator &o) const { return p_ != o.p_; }
+
+          private:
+            const char *p_;
+            const char **cursor_;
+        };
+
+        // Result of scanning a request without building a DOM. Spans point into the input.
+        struct request_envelope
+        {
+            bool parsed = false;      // input was well-formed JSON
+            bool is_batch = false;    // top-level array
+            bool is_object = false;   // top-level object
+            bool version_ok = false;  // "jsonrpc": "2.0"
+            bool method_ok = false;   // "method" present and a string
+            bool has_id = false;
+            bool id_ok = true;        // id is null, string or integer
+            bool has_params = false;
+            bool params_ok = true;    // params is array or object
+            std::optional<std::uint32_t> method; // interned id of a registered method
+            json id;                  // scalar, never a container
+            std::string_view params;  // raw bytes of params
+            std::vector<request_envelope> members; // batch members, scanned in the same pass
+
+            bool valid() const
+            {
+                return is_object && version_ok && method_ok && id_ok && params_ok;
+            }
+        };
+
+        // SAX handler that records the members of a request object, or of every object in a
+        // batch, and skips over everything nested below them. A batch is scanned once: each
+        // member fills its own envelope as the parser passes it. The method name is resolved
+        // by `Resolve` while it is still in the lexer's buffer; only a string id is copied.
+        template <typename Resolve> class envelope_scanner
+        {
+          public:
+            using number_integer_t = json::number_integer_t;
+            using number_unsigned_t = json::number_unsigned_t;
+            using number_float_t = json::number_float_t;
+            using string_t = json::string_t;
+            using binary_t = json::binary_t;
+
+            envelope_scanner(request_envelope &env, const char *base, const char **cursor,
+                             const Resolve &resolve)
+                : env_(env), base_(base), cursor_(cursor), resolve_(resolve)
+            {
+            }
+
+            bool null() { return scalar(json(nullptr)); }
+            bool boolean(bool) { return scalar(json(), false); }
+            bool number_integer(number_integer_t v) { return scalar(json(v)); }
+            bool number_unsigned(number_unsigned_t v) { return scalar(json(v)); }
+            bool number_float(number_float_t, const string_t &) { return scalar(json(), false); }
+            bool binary(binary_t &) { return scalar(json(), false); }
+            bool string(string_t &v)
+            {
+                if (at_members())
+                {
+                    request_envelope &env = target();
+                    switch (key_)
+                    {
+                    case member::jsonrpc:
+                        env.version_ok = (v == "2.0");
+                        return true;
+                    case member::method:
+                        env.method_ok = true;
+                        env.method = resolve_(std::string_view(v));
+                        return true;
+                    case member::id:
+                        env.has_id = true;
+                        env.id_ok = true;
+                        env.id = std::move(v);
+                        return true;
+                    default:
+                        break;
+                    }
+                }
+                return scalar(json(), false);
+            }
+
+            bool start_object(std::size_t) { return open(true); }
+            bool start_array(std::size_t) { return open(false); }
+            bool end_object() { return close(); }
+            bool end_array() { return close(); }
+
+            bool key(string_t &k)
+            {
+                if (depth_ == member_depth())
+                {
+                    if (k == "jsonrpc")
+                        key_ = member::jsonrpc;
+                    else if (k == "method")
+                        key_ = member::method;
+                    else if (k == "id")
+                        key_ = member::id;
+                    else if (k == "params")
+                        key_ = member::params;
+                    else
+                        key_ = member::other;
+                }
+                return true;
+            }
+
+            bool parse_error(std::size_t, const std::string &, const json::exception &)
+            {
+                return false;
+            }
+
+          private:
+            enum class member
+            {
+                other,
+                jsonrpc,
+                method,
+                id,
+                params
+            };
+
+            std::size_t offset() const { return static_cast<std::size_t>(*cursor_ - base_); }
+
+            // Depth at which the members of a request object are found
+            std::size_t member_depth() const { return env_.is_batch ? 2 : 1; }
+
+            // The request being scanned: the input itself, or the current batch member
+            request_envelope &target() { return env_.is_batch ? env_.members.back() : env_; }
+
+            bool at_members() { return depth_ == member_depth() && target().is_object; }
+
+            // A new batch member; only objects can be requests
+            void add_member(bool object)
+            {
+                request_envelope &m = env_.members.emplace_back();
+                m.parsed = true;
+                m.is_object = object;
+            }
+
+            // Scalar at the current position; `ok` is false for types no member accepts
+            bool scalar(json v, bool ok = true)
+            {
+                if (depth_ == 0)
+                    return true; // top-level scalar: neither object nor batch
+                if (env_.is_batch && depth_ == 1)
+                {
+                    add_member(false);
+                    return true;
+                }
+                if (!at_members())
+                    return true;
+                request_envelope &env = target();
+                switch (key_)
+                {
+                case member::jsonrpc:
+                    env.version_ok = false;
+                    break;
+                case member::method:
+                    env.method_ok = false;
+                    break;
+                case member::id:
+                    env.has_id = true;
+                    env.id_ok = ok;
+                    env.id = ok ? std::move(v) : json();
+                    break;
+                case member::params:
+                    env.has_params = true;
+                    env.params_ok = false;
+                    break;
+                default:
+                    break;
+                }
+                return true;
+            }
+
+            bool open(bool object)
+            {
+                // The opening bracket is the last byte the lexer consumed
+                const std::size_t at = offset() - 1;
+                if (depth_ == 0)
+                {
+                    env_.is_object = object;
+                    env_.is_batch = !object;
+                }
+                else if (env_.is_batch && depth_ == 1)
+                {
+                    add_member(object);
+                }
+                else if (at_members())
+                {
+                    if (key_ == member::params)
+                        start_ = at;
+                    else
+                        scalar(json(), false);
+                }
+                ++depth_;
+                return true;
+            }
+
+            bool close()
+            {
+                --depth_;
+                if (depth_ != 0 && at_members() && key_ == member::params)
+                {
+                    request_envelope &env = target();
+                    env.has_params = true;
+                    env.params_ok = true;
+                    env.params = std::string_view(base_ + start_, offset() - start_);
+                }
+                return true;
+            }
+
+            request_envelope &env_;
+            const char *base_;
+            const char **cursor_;
+            const Resolve &resolve_;
+            std::size_t depth_ = 0;
+            std::size_t start_ = 0;
+            member key_ = member::other;
+        };
+
+        // Scan `input` into `env` with the bundled SAX parser. Returns false on malformed JSON.
+        template <typename Resolve>
+        bool scan_envelope(std::string_view input, request_envelope &env, const Resolve &resolve)
+        {
+            const char *cursor = input.data();
+            envelope_scanner<Resolve> scanner(env, input.data(), &cursor, resolve);
+            env.parsed = json::sax_parse(tracking_iterator(input.data(), &cursor),
+                                         tracking_iterator(input.data() + input.size(), &cursor),
+                                         &scanner);
+            return env.parsed;
+        }
+
+        // DOM parser that also records where the top-level "id" member's value sits in the
+        // input, so a response can echo the id's bytes without serializing it again
+        class id_capturing_parser
+            : public nlohmann::detail::json_sax_dom_parser<
+                  json, nlohmann::detail::iterator_input_adapter<tracking_iterator>>
+        {
+            using base = nlohmann::detail::json_sax_dom_parser<
+                json, nlohmann::detail::iterator_input_adapter<tracking_iterator>>;
+
+          public:
+            id_capturing_parser(json &root, const char *base_ptr, const char **cursor)
+                : base(root, false), base_(base_ptr), cursor_(cursor)
+            {
+            }
+
+            // Raw bytes of an integer, string or null id; empty if there was none
+            std::string_view raw_id() const { return raw_id_; }
+
+            bool null() { return capture(false) && base::null(); }
+            bool number_integer(number_integer_t v)
+            {
+                return capture(false) && base::number_integer(v);
+            }
+            bool number_unsigned(number_unsigned_t v)
+            {
+                return capture(false) && base::number_unsigned(v);
+            }
+            bool string(string_t &v) { return capture(true) && base::string(v); }
+
+            bool start_object(std::size_t n)
+            {
+                ++depth_;
+                at_id_ = false;
+                return base::start_object(n);
+            }
+            bool start_array(std::size_t n)
+            {
+                ++depth_;
+                at_id_ = false;
+                return base::start_array(n);
+            }
+            bool end_object()
+            {
+                --depth_;
+                return base::end_object();
+            }
+            bool end_array()
+            {
+                --depth_;
+                return base::end_array();
+            }
+
+            bool key(string_t &k)
+            {
+                at_id_ = depth_ == 1 && k == "id";
+                key_end_ = offset(); // just past the key's closing quote
+                return base::key(k);
+            }
+
+          private:
+            std::size_t offset() const { return static_cast<std::size_t>(*cursor_ - base_); }
+
+            // Called for a scalar before it is stored. A string ends at the quote the lexer
+            // just consumed; null and integers end at the first delimiter.
+            bool capture(bool quoted)
+            {
+                if (!at_id_)
+                    return true;
+                at_id_ = false;
+                std::string_view rest(base_ + key_end_, offset() - key_end_);
+                std::size_t begin = rest.find_first_not_of(" \t\r\n:");
+                std::size_t end = quoted ? rest.size() : rest.find_first_of(" \t\r\n,}", begin);
+                raw_id_ = rest.substr(begin, end - begin);
+                return true;
+            }
+
+            const char *base_;
+            const char **cursor_;
+            std::size_t depth_ = 0;
+            std::size_t key_end_ = 0;
+            bool at_id_ = false;
+            std::string_view raw_id_;
+        };
+
+        // json::parse that also reports the raw bytes of the top-level id. Malformed input
+        // gives a discarded value, as json::parse(text, nullptr, false) does.
+        inline json parse_request(std::string_view text, std::string_view &raw_id)
+        {
+            json msg;
+            const char *cursor = text.data();
+            id_capturing_parser parser(msg, text.data(), &cursor);
+            if (!json::sax_parse(tracking_iterator(text.data(), &cursor),
+                                 tracking_iterator(text.data() + text.size(), &cursor), &parser))
+                return json(json::value_t::discarded);
+            raw_id = parser.raw_id();
+            return msg;
+        }
+    } // namespace detail
+
+    // --- Executors (parallel batch handling) ---
+    class executor
+    {
+      public:
+        virtual ~executor() = default;
+        // Run `task` at some point, possibly on another thread
+        virtual void execute(unique_function<void()> task) = 0;
+        // Number of tasks that can make progress at the same time
+        virtual std::size_t concurrency() const = 0;
+    };
+
+    // Fixed-size pool of worker threads sharing one FIFO task queue
+    class thread_pool : public executor
+    {
+      public:
+        explicit thread_pool(std::size_t threads = std::thread::hardware_concurrency())
+        {
+            threads = std::max<std::size_t>(threads, 1);
+            workers_.reserve(threads);
+            for (std::size_t i = 0; i < threads; ++i)
+                workers_.emplace_back([this] { run(); });
+        }
+
+        ~thread_pool() override
+        {
+            {
+                std::lock_guard lock(mutex_);
+                stopping_ = true;
+            }
+            ready_.notify_all();
+            for (auto &w : workers_)
+                w.join();
+        }
+
+        thread_pool(const thread_pool &) = delete;
+        thread_pool &operator=(const thread_pool &) = delete;
+
+        void execute(unique_function<void()> task) override
+        {
+            {
+                std::lock_guard lock(mutex_);
+                tasks_.push_back(std::move(task));
+            }
+            ready_.notify_one();
+        }
+
+        std::size_t concurrency() const override { return workers_.size(); }
+
+      private:
+        void run()
+        {
+            for (;;)
+            {
+                unique_function<void()> task;
+                {
+                    std::unique_lock lock(mutex_);
+                    ready_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                    if (tasks_.empty())
+                        return; // stopping and drained
+                    task = std::move(tasks_.front());
+                    tasks_.pop_front();
+                }
+                task();
+            }
+        }
+
+        std::vector<std::thread> workers_;
+        std::deque<unique_function<void()>> tasks_;
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        bool stopping_ = false;
+    };
+
+    // Response order for batches handled on an executor
+    enum class batch_order
+    {
+        preserve,  // responses in request order
+        completion // responses in the order they finish (allowed by the spec)
+    };
+
+    namespace detail
+    {
+        // Run fn(i) for i in [0, n) on `ex` and the calling thread, collecting the responses.
+        // Work is split into chunks claimed from a shared counter; the caller claims chunks too,
+        // so the batch completes even when called from a worker of a saturated pool.
+        template <typename F>
+        std::vector<json> run_batch(std::size_t n, executor &ex, batch_order order, F &&fn)
+        {
+            const std::size_t workers = std::max<std::size_t>(ex.concurrency(), 1);
+            const std::size_t chunk = std::max<std::size_t>(1, n / (workers * 4));
+            const std::size_t chunks = (n + chunk - 1) / chunk;
+
+            struct state
+            {
+                explicit state(std::size_t chunks) : done(static_cast<std::ptrdiff_t>(chunks)) {}
+                std::atomic<std::size_t> next{0};
+                std::latch done;
+                std::mutex mutex; // guards `out` (completion order) and `failure`
+                std::exception_ptr failure;
+            };
+            auto st = std::make_shared<state>(chunks);
+            std::vector<std::optional<json>> slots(order == batch_order::preserve ? n : 0);
+            std::vector<json> out;
+
+            // Helpers may start after the batch is done; they then claim nothing and only
+            // touch the shared state, which they keep alive.
+            auto work = [&, chunk, chunks](state &s)
+            {
+                for (;;)
+                {
+                    const std::size_t c = s.next.fetch_add(1, std::memory_order_relaxed);
+                    if (c >= chunks)
+                        return;
+                    const std::size_t end = std::min(n, (c + 1) * chunk);
+                    try
+                    {
+                        if (order == batch_order::preserve)
+                        {
+                            for (std::size_t i = c * chunk; i < end; ++i)
+                                slots[i] = fn(i);
+                        }
+                        else
+                        {
+                            std::vector<json> local;
+                            for (std::size_t i = c * chunk; i < end; ++i)
+                                if (auto r = fn(i))
+                                    local.push_back(std::move(*r));
+                            std::lock_guard lock(s.mutex);
+                            std::move(local.begin(), local.end(), std::back_inserter(out));
+                        }
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard lock(s.mutex);
+                        if (!s.failure)
+                            s.failure = std::current_exception();
+                    }
+                    s.done.count_down();
+                }
+            };
+            const std::size_t helpers = std::min(workers, chunks - 1);
+            for (std::size_t h = 0; h < helpers; ++h)
+                ex.execute([st, work]() mutable { work(*st); });
+            work(*st);
+            st->done.wait();
+            if (st->failure)
+                std::rethrow_exception(st->failure);
+
+            if (order == batch_order::preserve)
+            {
+                out.reserve(n);
+                for (auto &r : slots)
+                    if (r)
+                        out.push_back(std::move(*r));
+            }
+            return out;
+        }
+    } // namespace detail
+
+    namespace detail
+    {
+        // Request handling shared by the dispatchers. Derived supplies the method table:
+        //   std::optional<std::uint32_t> find(std::string_view method) const;
+        //   json call(std::uint32_t slot, const lazy_params &params) const;
+        template <typename Derived> class dispatcher_base
+        {
+          public:
+            // Handle a single request/notification. Returns optional response (none for
+            // notifications).
+            std::optional<json> handle_single(const json &msg) const
+            {
+                return rendered(handle_single_impl(msg));
+            }
+
+            // Same as above for a message the caller no longer needs: params are passed to the
+            // handler in place and the id is moved into the response instead of being copied.
+            std::optional<json> handle_single(json &&msg) const
+            {
+                return rendered(handle_single_impl(std::move(msg)));
+            }
+
+            // handle_single with the response left unrendered, for senders that write it
+            // straight into their output (see message_writer)
+            std::optional<response_parts> handle_single_parts(const json &msg) const
+            {
+                return handle_single_impl(msg);
+            }
+
+            std::optional<response_parts> handle_single_parts(json &&msg) const
+            {
+                return handle_single_impl(std::move(msg));
+            }
+
+            // Handle input that may be single or batch. Returns either a single response
+            // object, an array of response objects (for batch), or null if only notifications.
+            std::optional<json> handle(const json &input) const { return handle_impl(input); }
+
+            // Batch members are handled through handle_single(json&&) when the input is an
+            // rvalue
+            std::optional<json> handle(json &&input) const { return handle_impl(std::move(input)); }
+
+            // Handle input on `ex`: batch members are spread across the executor's threads and
+            // the calling thread. Handlers must be safe to call concurrently.
+            std::optional<json> handle(const json &input, executor &ex,
+                                       batch_order order = batch_order::preserve) const
+            {
+                return handle_impl(input, ex, order);
+            }
+
+            std::optional<json> handle(json &&input, executor &ex,
+                                       batch_order order = batch_order::preserve) const
+            {
+                return handle_impl(std::move(input), ex, order);
+            }
+
+            // Handle serialized input (single or batch) without building a DOM for the
+            // envelope. jsonrpc, method and id are scanned straight from the bytes; params are
+            // only parsed once a handler has been found for the method.
+            std::optional<json> handle_raw(std::string_view input) const
+            {
+                auto resolve = [this](std::string_view method) { return self().find(method); };
+                request_envelope env;
+                if (!scan_envelope(input, env, resolve))
+                    return make_error(nullptr, parse_error);
+                if (!env.is_batch)
+                    return handle_envelope(env);
+                if (env.members.empty())
+                    return make_error(nullptr, invalid_request);
+                std::vector<json> out;
+                out.reserve(env.members.size());
+                for (const auto &member : env.members)
+                {
+                    if (auto r = handle_envelope(member))
+                        out.push_back(std::move(*r));
+                }
+                if (out.empty())
+                    return std::nullopt;
+                return json(std::move(out));
+            }
+
+            // handle_raw with batch members dispatched on `ex` (see handle(input, ex, order))
+            std::optional<json> handle_raw(std::string_view input, executor &ex,
+                                           batch_order order = batch_order::preserve) const
+            {
+                auto resolve = [this](std::string_view method) { return self().find(method); };
+                request_envelope env;
+                if (!scan_envelope(input, env, resolve))
+                    return make_error(nullptr, parse_error);
+                if (!env.is_batch)
+                    return handle_envelope(env);
+                if (env.members.empty())
+                    return make_error(nullptr, invalid_request);
+                auto out = run_batch(env.members.size(), ex, order, [&](std::size_t i)
+                                     { return handle_envelope(env.members[i]); });
+                if (out.empty())
+                    return std::nullopt;
+                return json(std::move(out));
+            }
+
+          private:
+            const Derived &self() const { return static_cast<const Derived &>(*this); }
+
+            static std::optional<json> rendered(std::optional<response_parts> r)
+            {
+                if (!r)
+                    return std::nullopt;
+                return std::move(*r).to_json();
+            }
+
+            template <typename J> std::optional<response_parts> handle_single_impl(J &&msg) const
+            {
+                std::string why;
+                if (!validate_request(msg, &why))
+                {
+                    // Per spec, invalid request returns an error with id = null
+                    return response_parts{nullptr, {}, invalid_request};
+                }
+                const bool is_notif = !msg.contains("id");
+                auto slot = self().find(msg["method"].template get_ref<const std::string &>());
+                json id;
+                if (!is_notif)
+                {
+                    if constexpr (std::is_lvalue_reference_v<J>)
+                        id = msg["id"];
+                    else
+                        id = std::move(msg["id"]);
+                }
+                if (!slot)
+                {
+                    if (is_notif)
+                        return std::nullopt; // notifications get no response
+                    return response_parts{std::move(id), {}, method_not_found};
+                }
+                // params are handed to the handler in place; no copy is made
+                auto p = msg.find("params");
+                lazy_params params = p != msg.end() ? lazy_params(*p) : lazy_params();
+                return invoke(*slot, params, std::move(id), is_notif);
+            }
+
+            template <typename J>
+            std::optional<json> handle_impl(J &&input, executor &ex, batch_order order) const
+            {
+                if (!input.is_array() || input.size() < 2)
+                    return handle_impl(std::forward<J>(input));
+                auto out = run_batch(input.size(), ex, order,
+                                     [&](std::size_t i)
+                                     {
+                                         if constexpr (std::is_lvalue_reference_v<J>)
+                                             return handle_single(input[i]);
+                                         else
+                                             return handle_single(std::move(input[i]));
+                                     });
+                if (out.empty())
+                    return std::nullopt; // all were notifications
+                return json(std::move(out));
+            }
+
+            template <typename J> std::optional<json> handle_impl(J &&input) const
+            {
+                if (input.is_array())
+                {
+                    if (input.empty())
+                    {
+                        // Spec: empty batch is an invalid request
+                        return make_error(nullptr, invalid_request);
+                    }
+                    std::vector<json> out;
+                    out.reserve(input.size());
+                    for (auto &el : input)
+                    {
+                        std::optional<json> r;
+                        if constexpr (std::is_lvalue_reference_v<J>)
+                            r = handle_single(el);
+                        else
+                            r = handle_single(std::move(el));
+                        if (r)
+                            out.push_back(std::move(*r));
+                    }
+                    if (out.empty())
+                        return std::nullopt; // all were notifications
+                    return json(std::move(out));
+                }
+                else
+                {
+                    return handle_single(std::forward<J>(input));
+                }
+            }
+
+            std::optional<json> handle_envelope(const request_envelope &env) const
+            {
+                if (!env.valid())
+                    return make_error(nullptr, invalid_request);
+                const bool is_notif = !env.has_id;
+                if (!env.method)
+                {
+                    if (is_notif)
+                        return std::nullopt;
+                    return make_error(env.id, method_not_found);
+                }
+                lazy_params params = env.has_params ? lazy_params(env.params) : lazy_params();
+                return rendered(invoke(*env.method, params, env.id, is_notif));
+            }
+
+            std::optional<response_parts> invoke(std::uint32_t slot, const lazy_params &params,
+                                                 json id, bool is_notif) const
+            {
+                try
+                {
+                    json result = self().call(slot, params);
+                    if (is_notif)
+                        return std::nullopt;
+                    return response_parts{std::move(id), std::move(result), std::nullopt};
+                }
+                catch (const rpc_exception &ex)
+                {
+                    if (is_notif)
+                        return std::nullopt;
+                    return response_parts{std::move(id), {}, ex.err};
+                }
+                catch (const std::exception &ex)
+                {
+                    if (is_notif)
+                        return std::nullopt; // swallow per spec
+                    error e = internal_error;
+                    e.data = json{{"what", ex.what()}};
+                    return response_parts{std::move(id), {}, std::move(e)};
+                }
+            }
+        };
+    } // namespace detail
+
+    // Dispatcher
+    class dispatcher : public detail::dispatcher_base<dispatcher>
+    {
+      public:
+        using handler_t = unique_function<json(const json &params)>; // params: array or object
+        using lazy_handler_t = unique_function<json(const lazy_params &params)>;
+        using method_id = std::uint32_t;
+
+        // Add raw JSON handler (original method)
+        void add(const std::string &method, handler_t fn)
+        {
+            handlers_[slot_for(method)] = handler_entry{std::move(fn), nullptr};
+        }
+
+        // Add lazy handler: params are passed as unparsed bytes when the request came through
+        // handle_raw, so pass-through methods never pay for parsing or copying them
+        void add_lazy(const std::string &method, lazy_handler_t fn)
+        {
+            handlers_[slot_for(method)] = handler_entry{nullptr, std::move(fn)};
+        }
+
+        // Stable id for a method name. Names are interned once; the id indexes the handler
+        // table directly, so later lookups cost one hash of a string_view and no allocation.
+        method_id intern(std::string_view method)
+        {
+            auto it = ids_.find(method);
+            if (it != ids_.end())
+                return it->second;
+            if (frozen_)
+                throw std::logic_error("dispatcher is frozen: cannot add method " +
+                                       std::string(method));
+            auto id = static_cast<method_id>(handlers_.size());
+            ids_.emplace(std::string(method), id);
+            handlers_.emplace_back();
+            return id;
+        }
+
+        // Id of a method that has a handler registered
+        std::optional<method_id> find(std::string_view method) const
+        {
+            if (frozen_)
+                return frozen_table_.find(method);
+            auto it = ids_.find(method);
+            if (it == ids_.end() || !handlers_[it->second])
+                return std::nullopt;
+            return it->second;
+        }
+
+        bool contains(std::string_view method) const { return find(method).has_value(); }
+
+        // Fix the method set: builds a perfect-hash table over the registered names so that
+        // lookups are collision-free and branch-predictable. Handlers of registered methods
+        // may still be replaced; adding a new method afterwards throws std::logic_error.
+        void freeze()
+        {
+            std::vector<detail::perfect_hash_table::entry> keys;
+            keys.reserve(ids_.size());
+            for (const auto &[name, id] : ids_)
+            {
+                if (handlers_[id])
+                    keys.emplace_back(name, id);
+            }
+            frozen_table_.build(keys);
+            frozen_ = true;
+        }
+
+        bool is_frozen() const { return frozen_; }
+
+        // Add typed handler: takes C++ type ParamsT and returns ResultT
+        template <typename ParamsT, typename ResultT, typename F>
+        void add_typed(const std::string &method, F fn)
+        {
+            add(method, detail::make_typed_handler<ParamsT, ResultT, F>(std::move(fn)));
+        }
+
+        // Add no-params handler: takes no parameters and returns ResultT
+        template <typename ResultT, typename F>
+        void add_no_params(const std::string &method, F fn)
+        {
+            add(method, detail::make_no_params_handler<ResultT, F>(std::move(fn)));
+        }
+
+        // Look up and call the handler in `slot` (used by dispatcher_base)
+        json call(method_id slot, const lazy_params &params) const
+        {
+            const handler_entry &h = handlers_[slot];
+            return h.lazy ? h.lazy(params) : h.fn(params.get());
+        }
+
+      private:
+        struct handler_entry
+        {
+            handler_t fn;
+            lazy_handler_t lazy;
+
+            explicit operator bool() const { return fn || lazy; }
+        };
+
+        // Slot a registration writes to; once frozen only registered methods may be replaced
+        method_id slot_for(std::string_view method)
+        {
+            if (!frozen_)
+                return intern(method);
+            auto id = find(method);
+            if (!id)
+                throw std::logic_error("dispatcher is frozen: cannot add method " +
+                                       std::string(method));
+            return *id;
+        }
+
+        std::unordered_map<std::string, method_id, detail::string_hash, std::equal_to<>> ids_;
+        std::vector<handler_entry> handlers_; // indexed by method_id
+        detail::perfect_hash_table frozen_table_;
+        bool frozen_ = false;
+    };
+
+    namespace detail
+    {
+        // concurrent_dispatchers whose handlers are running on this thread, innermost last. A
+        // writer running inside a handler of its own dispatcher cannot wait for readers (it is
+        // one), so it defers reclamation instead; handlers of other dispatchers do not count.
+        inline thread_local std::vector<const void *> rcu_handler_owners;
+
+        struct rcu_handler_scope
+        {
+            explicit rcu_handler_scope(const void *owner) { rcu_handler_owners.push_back(owner); }
+            ~rcu_handler_scope() { rcu_handler_owners.pop_back(); }
+            rcu_handler_scope(const rcu_handler_scope &) = delete;
+            rcu_handler_scope &operator=(const rcu_handler_scope &) = delete;
+        };
+
+        inline bool rcu_in_handler_of(const void *owner)
+        {
+            return std::find(rcu_handler_owners.begin(), rcu_handler_owners.end(), owner) !=
+                   rcu_handler_owners.end();
+        }
+    } // namespace detail
+
+    // Dispatcher whose method set may change while other threads are dispatching. Requests
+    // run against an immutable, frozen snapshot; lookups take no lock and never wait (two
+    // atomic counter updates per request). Registrations and removals build a new snapshot
+    // under a writer mutex, publish it with one pointer swap, then wait for requests still
+    // using the old one before freeing it (RCU with two reader epochs).
+    class concurrent_dispatcher
+    {
+        // Handlers are shared between consecutive snapshots
+        struct entry
+        {
+            std::shared_ptr<dispatcher::handler_t> fn;
+            std::shared_ptr<dispatcher::lazy_handler_t> lazy;
+        };
+
+      public:
+        using handler_t = dispatcher::handler_t;
+        using lazy_handler_t = dispatcher::lazy_handler_t;
+
+        // A set of changes published as one snapshot (e.g. a plugin reload)
+        class batch
+        {
+          public:
+            void add(const std::string &method, handler_t fn)
+            {
+                ops_.emplace_back(method, entry{std::make_shared<handler_t>(std::move(fn)), {}});
+            }
+            void add_lazy(const std::string &method, lazy_handler_t fn)
+            {
+                ops_.emplace_back(method,
+                                  entry{{}, std::make_shared<lazy_handler_t>(std::move(fn))});
+            }
+            template <typename ParamsT, typename ResultT, typename F>
+            void add_typed(const std::string &method, F fn)
+            {
+                add(method, detail::make_typed_handler<ParamsT, ResultT, F>(std::move(fn)));
+            }
+            template <typename ResultT, typename F>
+            void add_no_params(const std::string &method, F fn)
+            {
+                add(method, detail::make_no_params_handler<ResultT, F>(std::move(fn)));
+            }
+            void remove(const std::string &method) { ops_.emplace_back(method, entry{}); }
+
+          private:
+            friend class concurrent_dispatcher;
+            std::vector<std::pair<std::string, entry>> ops_;
+        };
+
+        concurrent_dispatcher() { current_.store(build_snapshot()); }
+
+        // Start with the methods in `initial`. Each add() publishes a new snapshot of every
+        // method, so register a large method set this way (or with apply) rather than one
+        // add() at a time.
+        explicit concurrent_dispatcher(batch initial)
+        {
+            merge(initial);
+            current_.store(build_snapshot());
+        }
+
+        // No request may be running at this point
+        ~concurrent_dispatcher() { delete current_.load(std::memory_order_relaxed); }
+
+        concurrent_dispatcher(const concurrent_dispatcher &) = delete;
+        concurrent_dispatcher &operator=(const concurrent_dispatcher &) = delete;
+
+        // Register or replace a method; visible to requests that start after this returns
+        void add(const std::string &method, handler_t fn)
+        {
+            batch b;
+            b.add(method, std::move(fn));
+            apply(std::move(b));
+        }
+
+        void add_lazy(const std::string &method, lazy_handler_t fn)
+        {
+            batch b;
+            b.add_lazy(method, std::move(fn));
+            apply(std::move(b));
+        }
+
+        template <typename ParamsT, typename ResultT, typename F>
+        void add_typed(const std::string &method, F fn)
+        {
+            add(method, detail::make_typed_handler<ParamsT, ResultT, F>(std::move(fn)));
+        }
+
+        template <typename ResultT, typename F>
+        void add_no_params(const std::string &method, F fn)
+        {
+            add(method, detail::make_no_params_handler<ResultT, F>(std::move(fn)));
+        }
+
+        // Returns false if the method was not registered
+        bool remove(const std::string &method)
+        {
+            bool found = false;
+            update([&] { return found = registry_.erase(method) != 0; });
+            return found;
+        }
+
+        // Apply all changes in `b` and publish them together
+        void apply(batch b)
+        {
+            update(
+                [&]
+                {
+                    merge(b);
+                    return true;
+                });
+        }
+
+        bool contains(std::string_view method) const
+        {
+            read_guard g(*this);
+            return g.snap->contains(method);
+        }
+
+        // Same entry points as dispatcher; each request runs against the snapshot current
+        // when it started.
+        std::optional<json> handle_single(const json &msg) const
+        {
+            read_guard g(*this);
+            return g.snap->handle_single(msg);
+        }
+        std::optional<json> handle_single(json &&msg) const
+        {
+            read_guard g(*this);
+            return g.snap->handle_single(std::move(msg));
+        }
+        std::optional<json> handle(const json &input) const
+        {
+            read_guard g(*this);
+            return g.snap->handle(input);
+        }
+        std::optional<json> handle(json &&input) const
+        {
+            read_guard g(*this);
+            return g.snap->handle(std::move(input));
+        }
+        std::optional<json> handle(const json &input, executor &ex,
+                                   batch_order order = batch_order::preserve) const
+        {
+            read_guard g(*this);
+            return g.snap->handle(input, ex, order);
+        }
+        std::optional<json> handle(json &&input, executor &ex,
+                                   batch_order order = batch_order::preserve) const
+        {
+            read_guard g(*this);
+            return g.snap->handle(std::move(input), ex, order);
+        }
+        std::optional<json> handle_raw(std::string_view input) const
+        {
+            read_guard g(*this);
+            return g.snap->handle_raw(input);
+        }
+        std::optional<json> handle_raw(std::string_view input, executor &ex,
+                                       batch_order order = batch_order::preserve) const
+        {
+            read_guard g(*this);
+            return g.snap->handle_raw(input, ex, order);
+        }
+
+      private:
+        // Read-side critical section: pins the current snapshot
+        struct read_guard
+        {
+            explicit read_guard(const concurrent_dispatcher &d)
+                : readers(d.readers_[d.epoch_.load(std::memory_order_acquire) & 1])
+            {
+                readers.fetch_add(1, std::memory_order_seq_cst);
+                snap = d.current_.load(std::memory_order_seq_cst);
+            }
+            ~read_guard() { readers.fetch_sub(1, std::memory_order_release); }
+            read_guard(const read_guard &) = delete;
+            read_guard &operator=(const read_guard &) = delete;
+
+            std::atomic<std::size_t> &readers;
+            const dispatcher *snap;
+        };
+
+        void merge(batch &b)
+        {
+            for (auto &[name, e] : b.ops_)
+            {
+                if (e.fn || e.lazy)
+                    registry_[name] = std::move(e);
+                else
+                    registry_.erase(name);
+            }
+        }
+
+        dispatcher *build_snapshot() const
+        {
+            auto next = std::make_unique<dispatcher>();
+            for (const auto &[name, e] : registry_)
+            {
+                if (e.fn)
+                    next->add(name,
+                              [this, h = e.fn](const json &params) -> json
+                              {
+                                  detail::rcu_handler_scope scope(this);
+                                  return (*h)(params);
+                              });
+                else
+                    next->add_lazy(name,
+                                   [this, h = e.lazy](const lazy_params &params) -> json
+                                   {
+                                       detail::rcu_handler_scope scope(this);
+                                       return (*h)(params);
+                                   });
+            }
+            next->freeze();
+            return next.release();
+        }
+
+        // Run `edit` on registry_, swap in a snapshot of the result and reclaim the old one
+        // once no request uses it. The wait happens outside the writer mutex, so a handler
+        // that registers methods never blocks behind a writer waiting for that handler.
+        template <typename Edit> void update(Edit &&edit)
+        {
+            std::vector<std::unique_ptr<dispatcher>> garbage;
+            {
+                std::lock_guard lock(write_mutex_);
+                if (!edit())
+                    return;
+                std::unique_ptr<dispatcher> next(build_snapshot());
+                retired_.emplace_back(current_.exchange(next.release(), std::memory_order_seq_cst));
+                if (detail::rcu_in_handler_of(this))
+                    return; // this thread is a reader; freed by a later writer or the destructor
+                garbage.swap(retired_);
+            }
+            synchronize();
+        }
+
+        // Wait until every request that may have seen a retired snapshot has finished. New
+        // requests are steered to the other counter first so the wait cannot be starved.
+        void synchronize()
+        {
+            for (int flip = 0; flip < 2; ++flip)
+            {
+                unsigned old = epoch_.fetch_add(1, std::memory_order_seq_cst) & 1;
+                while (readers_[old].load(std::memory_order_seq_cst) != 0)
+                    std::this_thread::yield();
+            }
+        }
+
+        std::atomic<dispatcher *> current_;
+        std::atomic<unsigned> epoch_{0};
+        mutable std::array<std::atomic<std::size_t>, 2> readers_{};
+        std::mutex write_mutex_;
+        std::map<std::string, entry, std::less<>> registry_;
+        std::vector<std::unique_ptr<dispatcher>> retired_;
+    };
+
+    // --- Compile-time method registry ---
+    namespace detail
+    {
+        // String literal usable as a template argument
+        template <std::size_t N> struct fixed_string
+        {
+            char chars[N]{};
+            constexpr fixed_string(const char (&s)[N]) { std::copy_n(s, N, chars); }
+            constexpr std::string_view view() const { return {chars, N - 1}; }
+        };
+
+        template <typename F> struct fn_traits;
+        template <typename R, typename... A> struct fn_traits<R (*)(A...)>
+        {
+            using result = R;
+            using args = std::tuple<std::decay_t<A>...>;
+            static constexpr std::size_t arity = sizeof...(A);
+        };
+        template <typename R, typename... A>
+        struct fn_traits<R (*)(A...) noexcept> : fn_traits<R (*)(A...)>
+        {
+        };
+
+        // Call a handler known at compile time. Accepts json(const json&),
+        // json(const lazy_params&), R(ParamsT) and R(); typed params follow add_typed rules.
+        template <auto Fn> json call_static(const lazy_params &params)
+        {
+            using traits = fn_traits<decltype(Fn)>;
+            using R = typename traits::result;
+            auto finish = [](auto &&...call) -> json
+            {
+                if constexpr (std::is_void_v<R>)
+                {
+                    Fn(std::forward<decltype(call)>(call)...);
+                    return json(nullptr);
+                }
+                else
+                {
+                    return serialize_result(Fn(std::forward<decltype(call)>(call)...));
+                }
+            };
+            if constexpr (traits::arity == 0)
+            {
+                return finish();
+            }
+            else
+            {
+                static_assert(traits::arity == 1, "handlers take at most one parameter");
+                using P = std::tuple_element_t<0, typename traits::args>;
+                if constexpr (std::is_same_v<P, lazy_params>)
+                    return finish(params);
+                else if constexpr (std::is_same_v<P, json>)
+                    return finish(params.get());
+                else
+                    return finish(params.template as<P>());
+            }
+        }
+
+        // Compile-time routing: find a shift/mask pair that sends every name's hash to its own
+        // slot, so a lookup is one hash, one small-integer switch and one compare.
+        template <std::size_t N> struct route_table
+        {
+            unsigned shift = 0;
+            std::uint64_t mask = 0;
+            std::array<std::uint64_t, N> slot{};
+        };
+
+        template <std::size_t N>
+        constexpr bool unique_names(const std::array<std::string_view, N> &names)
+        {
+            for (std::size_t i = 0; i < N; ++i)
+                for (std::size_t j = i + 1; j < N; ++j)
+                    if (names[i] == names[j])
+                        return false;
+            return true;
+        }
+
+        template <std::size_t N>
+        constexpr route_table<N> make_route(const std::array<std::string_view, N> &names)
+        {
+            route_table<N> t;
+            std::array<std::uint64_t, N> hashes{};
+            for (std::size_t i = 0; i < N; ++i)
+                hashes[i] = hash_name(names[i], 0);
+            for (std::uint64_t size = std::bit_ceil(N > 1 ? N : 1);; size *= 2)
+            {
+                for (unsigned shift = 0; shift + std::countr_zero(size) <= 64; ++shift)
+                {
+                    bool distinct = true;
+                    for (std::size_t i = 0; i < N && distinct; ++i)
+                    {
+                        t.slot[i] = (hashes[i] >> shift) & (size - 1);
+                        for (std::size_t j = 0; j < i && distinct; ++j)
+                            distinct = t.slot[j] != t.slot[i];
+                    }
+                    if (distinct)
+                    {
+                        t.shift = shift;
+                        t.mask = size - 1;
+                        return t;
+                    }
+                }
+            }
+        }
+    } // namespace detail
+
+    // A method bound at compile time: method<"add", &add>
+    template <detail::fixed_string Name, auto Fn> struct method
+    {
+        static constexpr std::string_view name = Name.view();
+        static constexpr auto fn = Fn;
+    };
+
+    // Dispatcher over a method set fixed at compile time. Routing is generated from the names
+    // and handlers are called directly (no type erasure), so typed handlers can be inlined.
+    template <typename... Methods>
+    class static_dispatcher : public detail::dispatcher_base<static_dispatcher<Methods...>>
+    {
+        static constexpr std::size_t count = sizeof...(Methods);
+        static constexpr std::array<std::string_view, count> names_{Methods::name...};
+        static_assert(detail::unique_names(names_), "duplicate method name in static_dispatcher");
+        static constexpr auto route_ = detail::make_route(names_);
+
+      public:
+        using method_id = std::uint32_t;
+
+        static constexpr std::size_t size() { return count; }
+
+        // Index of a method in the template argument list
+        std::optional<method_id> find(std::string_view method) const
+        {
+            const std::uint64_t slot = (detail::hash_name(method, 0) >> route_.shift) & route_.mask;
+            std::optional<method_id> out;
+            [&]<std::size_t... I>(std::index_sequence<I...>)
+            {
+                (void)((slot == route_.slot[I] && method == names_[I]
+                            ? (out = static_cast<method_id>(I), true)
+                            : false) ||
+                       ...);
+            }(std::make_index_sequence<count>{});
+            return out;
+        }
+
+        bool contains(std::string_view method) const { return find(method).has_value(); }
+
+        // Call the handler at `index` (used by dispatcher_base)
+        json call(method_id index, const lazy_params &params) const
+        {
+            json out;
+            [&]<std::size_t... I>(std::index_sequence<I...>)
+            {
+                (void)((index == I ? (out = detail::call_static<Methods::fn>(params), true)
+                                   : false) ||
+                       ...);
+            }(std::make_index_sequence<count>{});
+            return out;
+        }
+    };
+
+    // --- Handler call context (progress + cancellation) ---
+    struct call_context
+    {
+        json id;                                          // null for notifications
+        function_ref<void(const json &value)> progress; // send $/progress
+        function_ref<bool()> is_canceled;               // polling cancellation
+    };
+
+    namespace detail
+    {
+        inline thread_local call_context *tls_ctx = nullptr;
+
+        // Installs a context for the current thread and restores the previous one on exit
+        struct context_scope
+        {
+            explicit context_scope(call_context *ctx) : prev(std::exchange(tls_ctx, ctx)) {}
+            ~context_scope() { tls_ctx = prev; }
+            context_scope(const context_scope &) = delete;
+            context_scope &operator=(const context_scope &) = delete;
+
+            call_context *prev;
+        };
+    } // namespace detail
+
+    inline const call_context *current_context() { return detail::tls_ctx; }
+    inline bool is_canceled()
+    {
+        return detail::tls_ctx && detail::tls_ctx->is_canceled && detail::tls_ctx->is_canceled();
+    }
+    inline void report_progress(const json &value)
+    {
+        if (detail::tls_ctx && detail::tls_ctx->progress)
+            detail::tls_ctx->progress(value);
+    }
+
+    // --- Coroutine tasks (asynchronous handlers) ---
+    template <typename T = json> class task;
+
+    namespace detail
+    {
+        template <typename T> struct is_task : std::false_type
+        {
+        };
+        template <typename T> struct is_task<task<T>> : std::true_type
+        {
+        };
+
+        // Call context of a chain of tasks: `ctx` is installed while any task of the chain runs,
+        // `prev` is what the thread that resumed the chain had installed.
+        struct task_context
+        {
+            call_context *ctx = nullptr;
+            call_context *prev = nullptr;
+        };
+
+        // Installs the task's call context around a suspension point
+        template <typename Awaiter> struct context_awaiter
+        {
+            Awaiter inner;
+            task_context *link;
+            bool suspended = false;
+
+            bool await_ready() { return inner.await_ready(); }
+
+            template <typename P> auto await_suspend(std::coroutine_handle<P> h)
+            {
+                suspended = true;
+                tls_ctx = link->prev;
+                return inner.await_suspend(h);
+            }
+
+            decltype(auto) await_resume()
+            {
+                if (suspended)
+                {
+                    link->prev = tls_ctx;
+                    tls_ctx = link->ctx;
+                }
+                return inner.await_resume();
+            }
+        };
+
+        struct task_promise_base
+        {
+            task_context own;
+            task_context *link = &own; // nested tasks share the root's context
+            std::coroutine_handle<> continuation;
+            std::exception_ptr error;
+
+            struct initial_awaiter
+            {
+                task_promise_base *p;
+
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<>) const noexcept {}
+                void await_resume() const noexcept
+                {
+                    if (p->link == &p->own)
+                        p->own = {tls_ctx, tls_ctx}; // root task: adopt the starting context
+                }
+            };
+
+            struct final_awaiter
+            {
+                bool await_ready() const noexcept { return false; }
+                template <typename P>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) const noexcept
+                {
+                    auto &p = h.promise();
+                    if (p.link == &p.own)
+                        tls_ctx = p.own.prev;
+                    return p.continuation ? p.continuation : std::noop_coroutine();
+                }
+                void await_resume() const noexcept {}
+            };
+
+            initial_awaiter initial_suspend() noexcept { return {this}; }
+            final_awaiter final_suspend() noexcept { return {}; }
+            void unhandled_exception() { error = std::current_exception(); }
+
+            // Nested tasks are awaited as-is; anything else gets the context restored on resume
+            template <typename A> decltype(auto) await_transform(A &&a)
+            {
+                if constexpr (is_task<std::remove_cvref_t<A>>::value)
+                    return std::forward<A>(a);
+                else if constexpr (requires { std::forward<A>(a).operator co_await(); })
+                {
+                    using awaiter = decltype(std::forward<A>(a).operator co_await());
+                    return context_awaiter<awaiter>{std::forward<A>(a).operator co_await(), link};
+                }
+                else
+                    return context_awaiter<A>{std::forward<A>(a), link};
+            }
+        };
+
+        template <typename T> struct task_promise : task_promise_base
+        {
+            std::optional<T> value;
+
+            template <typename U = T> void return_value(U &&v)
+            {
+                value.emplace(std::forward<U>(v));
+            }
+            T take()
+            {
+                if (error)
+                    std::rethrow_exception(error);
+                return std::move(*value);
+            }
+        };
+
+        template <> struct task_promise<void> : task_promise_base
+        {
+            void return_void() {}
+            void take()
+            {
+                if (error)
+                    std::rethrow_exception(error);
+            }
+        };
+    } // namespace detail
+
+    // Lazily started coroutine producing a T. Awaiting a task starts it and resumes the awaiter
+    // when it completes. current_context(), is_canceled() and report_progress() keep referring
+    // to the request that started the task across co_await, whichever thread resumes it.
+    template <typename T> class task
+    {
+      public:
+        struct promise_type : detail::task_promise<T>
+        {
+            task get_return_object()
+            {
+                return task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+        };
+
+        task(task &&other) noexcept : h_(std::exchange(other.h_, nullptr)) {}
+        task &operator=(task &&other) noexcept
+        {
+            if (this != &other)
+            {
+                if (h_)
+                    h_.destroy();
+                h_ = std::exchange(other.h_, nullptr);
+            }
+            return *this;
+        }
+        task(const task &) = delete;
+        task &operator=(const task &) = delete;
+        ~task()
+        {
+            if (h_)
+                h_.destroy();
+        }
+
+        bool await_ready() const noexcept { return !h_ || h_.done(); }
+
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> awaiting) noexcept
+        {
+            h_.promise().continuation = awaiting;
+            if constexpr (std::is_base_of_v<detail::task_promise_base, P>)
+                h_.promise().link = awaiting.promise().link;
+            return h_;
+        }
+
+        T await_resume() { return h_.promise().take(); }
+
+      private:
+        explicit task(std::coroutine_handle<promise_type> h) : h_(h) {}
+
+        std::coroutine_handle<promise_type> h_;
+    };
+
+    namespace detail
+    {
+        // Fire-and-forget coroutine: starts immediately and frees itself on completion
+        struct detached_task
+        {
+            struct promise_type
+            {
+                detached_task get_return_object() noexcept { return {}; }
+                std::suspend_never initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() noexcept {}
+                void unhandled_exception() noexcept { std::terminate(); }
+            };
+        };
+
+        // Coroutine suspended on a client call, completed by the response or a local cancel
+        struct call_waiter
+        {
+            std::coroutine_handle<> handle;
+            std::optional<json> result;
+            json error;             // error object when there is no result
+            bool sending = false;   // still in await_suspend: not suspended yet
+            bool completed = false; // completed while sending; await_suspend doesn't suspend
+
+            void complete(std::optional<json> res, json err)
+            {
+                result = std::move(res);
+                error = std::move(err);
+                if (sending)
+                    completed = true;
+                else
+                    handle.resume();
+            }
+        };
+
+        inline error error_from_object(const json &e)
+        {
+            if (!e.is_object())
+                return internal_error;
+            error out{e.value("code", internal_error.code),
+                      e.value("message", internal_error.message)};
+            if (auto d = e.find("data"); d != e.end())
+                out.data = *d;
+            return out;
+        }
+    } // namespace detail
+
+    // Start a task without awaiting it. An exception escaping the task terminates the program.
+    template <typename T> void spawn(task<T> t)
+    {
+        [](task<T> t) -> detail::detached_task { co_await std::move(t); }(std::move(t));
+    }
+
+    namespace detail
+    {
+        // Open-addressing table keyed by integer ids (linear probing from id % capacity,
+        // backward-shift deletion). Sequential ids land in consecutive slots, so lookups almost
+        // never probe. Id 0 marks a free slot.
+        template <typename T> class id_slot_table
+        {
+          public:
+            void insert(std::uint64_t id, T value)
+            {
+                if ((size_ + 1) * 2 > slots_.size())
+                    grow();
+                std::size_t i = id & mask();
+                while (slots_[i].id != 0)
+                    i = (i + 1) & mask();
+                slots_[i].id = id;
+                slots_[i].value = std::move(value);
+                ++size_;
+            }
+
+            T *find(std::uint64_t id)
+            {
+                std::size_t i = index_of(id);
+                return i != npos ? &slots_[i].value : nullptr;
+            }
+
+            std::optional<T> take(std::uint64_t id)
+            {
+                std::size_t i = index_of(id);
+                if (i == npos)
+                    return std::nullopt;
+                std::optional<T> out(std::move(slots_[i].value));
+                erase_at(i);
+                return out;
+            }
+
+            std::size_t size() const { return size_; }
+
+          private:
+            static constexpr std::size_t npos = ~std::size_t(0);
+
+            struct slot
+            {
+                std::uint64_t id = 0;
+                T value{};
+            };
+
+            std::size_t mask() const { return slots_.size() - 1; }
+
+            std::size_t index_of(std::uint64_t id) const
+            {
+                if (id == 0 || slots_.empty())
+                    return npos;
+                for (std::size_t i = id & mask(); slots_[i].id != 0; i = (i + 1) & mask())
+                {
+                    if (slots_[i].id == id)
+                        return i;
+                }
+                return npos;
+            }
+
+            // Free slot i and pull later entries of the probe run back so lookups still find
+            // them without tombstones
+            void erase_at(std::size_t i)
+            {
+                slots_[i].id = 0;
+                slots_[i].value = T{};
+                --size_;
+                for (std::size_t j = (i + 1) & mask(); slots_[j].id != 0; j = (j + 1) & mask())
+                {
+                    std::size_t home = slots_[j].id & mask();
+                    // Entry j may move to i unless its home lies cyclically in (i, j]
+                    bool stays = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+                    if (stays)
+                        continue;
+                    slots_[i].id = slots_[j].id;
+                    slots_[i].value = std::move(slots_[j].value);
+                    slots_[j].id = 0;
+                    slots_[j].value = T{};
+                    i = j;
+                }
+            }
+
+            void grow()
+            {
+                std::vector<slot> old = std::exchange(
+                    slots_, std::vector<slot>(std::max<std::size_t>(64, slots_.size() * 2)));
+                size_ = 0;
+                for (slot &s : old)
+                {
+                    if (s.id != 0)
+                        insert(s.id, std::move(s.value));
+                }
+            }
+
+            std::vector<slot> slots_;
+            std::size_t size_ = 0;
+        };
+
+        // Hierarchical timing wheel: 4 levels of 64 slots over ticks of `tick` length. Timers
+        // are nodes in a pooled, intrusive doubly linked list per slot, so scheduling and
+        // cancelling are O(1) and advancing costs O(1) per tick plus O(1) per timer each time
+        // it cascades to a lower level. Deadlines beyond 2^24 ticks are parked in the top level
+        // and re-placed when they come around.
+        template <typename T> class timer_wheel
+        {
+          public:
+            using clock = std::chrono::steady_clock;
+
+            // Identifies a scheduled timer; stale after it fires or is cancelled
+            struct handle
+            {
+                std::uint32_t index = 0;
+                std::uint32_t gen = 0; // 0: no timer
+
+                explicit operator bool() const { return gen != 0; }
+            };
 
-        // Wrapper for no-params handlers
-        template <typename ResultT>
-        std::function<json(const json &)> make_no_params_handler(std::function<ResultT()> fn)
-        {
-            return [fn = std::move(fn)](const json &) -> json
+            explicit timer_wheel(clock::duration tick = std::chrono::milliseconds(1),
+                                 clock::time_point start = clock::now())
+                : tick_(tick), start_(start)
             {
-                if constexpr (std::is_same_v<ResultT, void>)
+                heads_.fill(nil);
+            }
+
+            // Fire `payload` on the first advance() past `deadline`
+            handle schedule(clock::time_point deadline, T payload)
+            {
+                // Rounded up, so a timer never fires before its deadline
+                std::uint64_t expires = std::max(to_ticks(deadline, true), now_ + 1);
+                std::uint32_t n;
+                if (!free_.empty())
                 {
-                    fn();
-                    return json(nullptr);
+                    n = free_.back();
+                    free_.pop_back();
                 }
                 else
                 {
-                    ResultT result = fn();
-                    return serialize_result(std::move(result));
+                    n = static_cast<std::uint32_t>(nodes_.size());
+                    nodes_.emplace_back();
                 }
-            };
-        }
-    } // namespace detail
+                nodes_[n].expires = expires;
+                nodes_[n].payload = std::move(payload);
+                place(n);
+                ++size_;
+                return {n, nodes_[n].gen};
+            }
 
-    // Dispatcher
-    class dispatcher
-    {
-      public:
-        using handler_t = std::function<json(const json &params)>; // params may be array or object
+            // Returns false if the timer already fired or was cancelled
+            bool cancel(handle h)
+            {
+                if (!h || h.index >= nodes_.size() || nodes_[h.index].gen != h.gen)
+                    return false;
+                unlink(h.index);
+                release(h.index);
+                return true;
+            }
 
-        // Add raw JSON handler (original method)
-        void add(const std::string &method, handler_t fn) { handlers_[method] = std::move(fn); }
+            // Fire every timer due at `now`, in deadline order (by tick), calling
+            // on_expire(T&&). on_expire may schedule and cancel timers.
+            template <typename F> void advance(clock::time_point now, F &&on_expire)
+            {
+                const std::uint64_t target = to_ticks(now);
+                while (now_ < target)
+                {
+                    if (size_ == 0)
+                    {
+                        now_ = target; // nothing scheduled: skip idle time
+                        break;
+                    }
+                    ++now_;
+                    for (unsigned level = 1; level < levels; ++level)
+                    {
+                        if ((now_ & ((std::uint64_t(1) << (bits * level)) - 1)) != 0)
+                            break;
+                        cascade(level);
+                    }
+                    std::uint32_t &head = heads_[now_ & (slots - 1)];
+                    while (head != nil)
+                    {
+                        std::uint32_t n = head;
+                        unlink(n);
+                        T payload = std::move(nodes_[n].payload);
+                        release(n);
+                        on_expire(std::move(payload));
+                    }
+                }
+            }
 
-        // Add typed handler: takes C++ type ParamsT and returns ResultT
-        template <typename ParamsT, typename ResultT>
-        void add_typed(const std::string &method, std::function<ResultT(ParamsT)> fn)
-        {
-            handlers_[method] = detail::make_typed_handler<ParamsT, ResultT>(std::move(fn));
-        }
+            std::size_t size() const { return size_; }
 
-        // Add no-params handler: takes no parameters and returns ResultT
-        template <typename ResultT>
-        void add_no_params(const std::string &method, std::function<ResultT()> fn)
-        {
-            handlers_[method] = detail::make_no_params_handler<ResultT>(std::move(fn));
-        }
+          private:
+            static constexpr unsigned bits = 6;
+            static constexpr unsigned slots = 1u << bits;
+            static constexpr unsigned levels = 4;
+            static constexpr std::uint32_t nil = ~std::uint32_t(0);
 
-        // Handle a single request/notification. Returns optional response (none for notifications).
-        std::optional<json> handle_single(const json &msg) const
-        {
-            std::string why;
-            if (!validate_request(msg, &why))
+            struct node
             {
-                // Per spec, invalid request returns an error with id = null
-                return make_error(nullptr, invalid_request);
-            }
-            const std::string method = msg["method"].get<std::string>();
-            const bool is_notif = !msg.contains("id");
-            const json id = is_notif ? json() : msg["id"]; // null if notification
+                std::uint64_t expires = 0;
+                std::uint32_t prev = nil;
+                std::uint32_t next = nil;
+                std::uint32_t bucket = nil;
+                std::uint32_t gen = 1;
+                T payload{};
+            };
 
-            auto it = handlers_.find(method);
-            if (it == handlers_.end())
+            std::uint64_t to_ticks(clock::time_point t, bool round_up = false) const
             {
-                if (is_notif)
-                    return std::nullopt; // notifications get no response
-                return make_error(id, method_not_found);
+                if (t <= start_)
+                    return 0;
+                auto elapsed = t - start_;
+                if (round_up)
+                    elapsed += tick_ - clock::duration(1);
+                return static_cast<std::uint64_t>(elapsed / tick_);
             }
-            try
+
+            // Link node n into the slot matching its distance from now_
+            void place(std::uint32_t n)
             {
-                json params = msg.contains("params") ? msg["params"] : json{};
-                json result = it->second(params);
-                if (is_notif)
-                    return std::nullopt;
-                return make_result(id, result);
+                std::uint64_t expires = nodes_[n].expires;
+                std::uint64_t delta = expires - now_;
+                unsigned level = 0;
+                while (level + 1 < levels && delta >= (std::uint64_t(1) << (bits * (level + 1))))
+                    ++level;
+                const std::uint64_t range = std::uint64_t(1) << (bits * levels);
+                if (delta >= range)
+                    expires = now_ + range - 1; // parked; re-placed when its slot cascades
+                std::uint32_t b = level * slots + ((expires >> (bits * level)) & (slots - 1));
+                node &nd = nodes_[n];
+                nd.bucket = b;
+                nd.prev = nil;
+                nd.next = heads_[b];
+                if (nd.next != nil)
+                    nodes_[nd.next].prev = n;
+                heads_[b] = n;
             }
-            catch (const rpc_exception &ex)
+
+            void unlink(std::uint32_t n)
             {
-                if (is_notif)
-                    return std::nullopt;
-                return make_error(id, ex.err);
+                node &nd = nodes_[n];
+                if (nd.prev != nil)
+                    nodes_[nd.prev].next = nd.next;
+                else
+                    heads_[nd.bucket] = nd.next;
+                if (nd.next != nil)
+                    nodes_[nd.next].prev = nd.prev;
+                nd.bucket = nil;
             }
-            catch (const std::exception &ex)
+
+            void release(std::uint32_t n)
             {
-                if (is_notif)
-                    return std::nullopt; // swallow per spec
-                error e = internal_error;
-                e.data = json{{"what", ex.what()}};
-                return make_error(id, e);
+                node &nd = nodes_[n];
+                nd.payload = T{};
+                if (++nd.gen == 0)
+                    nd.gen = 1;
+                free_.push_back(n);
+                --size_;
             }
-        }
 
-        // Handle input that may be single or batch. Returns either a single response object,
-        // an array of response objects (for batch), or null if only notifications.
-        std::optional<json> handle(const json &input) const
-        {
-            if (input.is_array())
+            // Move the timers of the current slot of `level` down to finer levels
+            void cascade(unsigned level)
             {
-                if (input.empty())
-                {
-                    // Spec: empty batch is an invalid request
-                    return make_error(nullptr, invalid_request);
-                }
-                std::vector<json> out;
-                out.reserve(input.size());
-                for (const auto &el : input)
+                std::uint32_t b = level * slots + ((now_ >> (bits * level)) & (slots - 1));
+                std::uint32_t n = std::exchange(heads_[b], nil);
+                while (n != nil)
                 {
-                    auto r = handle_single(el);
-                    if (r)
-                        out.push_back(*r);
+                    std::uint32_t next = nodes_[n].next;
+                    place(n);
+                    n = next;
                 }
-                if (out.empty())
-                    return std::nullopt; // all were notifications
-                return json(out);
-            }
-            else
-            {
-                return handle_single(input);
             }
-        }
 
-      private:
-        std::unordered_map<std::string, handler_t> handlers_;
-    };
+            clock::duration tick_;
+            clock::time_point start_;
+            std::uint64_t now_ = 0; // last processed tick
+            std::array<std::uint32_t, slots * levels> heads_;
+            std::vector<node> nodes_;
+            std::vector<std::uint32_t> free_;
+            std::size_t size_ = 0;
+        };
+    } // namespace detail
 
-    // --- Handler call context (progress + cancellation) ---
-    struct call_context
+    // Endpoint configuration
+    struct endpoint_options
     {
-        json id;                                         // null for notifications
-        std::function<void(const json &value)> progress; // send $/progress
-        std::function<bool()> is_canceled;               // polling cancellation
-    };
+        // Client request ids are the integers 1, 2, ... instead of "req-N". Pending requests
+        // are then kept in a slot array indexed by id, so a round trip needs no id formatting,
+        // string hashing or allocation.
+        bool numeric_ids = false;
 
-    namespace detail
-    {
-        inline thread_local call_context *tls_ctx = nullptr;
-    }
+        // Deadline for client requests that do not pass their own; zero disables it. Expired
+        // requests fail with request_timeout when endpoint::poll() runs.
+        std::chrono::milliseconds default_timeout{0};
 
-    inline const call_context *current_context() { return detail::tls_ctx; }
-    inline bool is_canceled() { return detail::tls_ctx ? detail::tls_ctx->is_canceled() : false; }
-    inline void report_progress(const json &value)
-    {
-        if (detail::tls_ctx && detail::tls_ctx->progress)
-            detail::tls_ctx->progress(value);
-    }
+        // Client-side coalescing: outgoing requests and notifications are queued and sent as
+        // one JSON array once batch_max_messages or batch_max_bytes (0: no limit) is reached,
+        // when batch_window has passed (checked by endpoint::poll()) or on endpoint::flush().
+        bool batching = false;
+        std::chrono::microseconds batch_window{1000};
+        std::size_t batch_max_messages = 64;
+        std::size_t batch_max_bytes = 0;
+    };
 
     // --- Endpoint: transport + client/server conveniences (MCP/LSP-style) ---
     class endpoint
     {
       public:
-        using send_fn = std::function<void(const json &)>;
-        using result_cb = std::function<void(const json &)>;
-        using error_cb = std::function<void(const json &)>;
+        // Outgoing messages are handed over as rvalues: a sender taking `const json &` works,
+        // one taking `json &&` (or `json`) can keep the message without copying it
+        using send_fn = std::function<void(json &&)>;
+        // Optional sender for single responses, which are then never built as json
+        using response_fn = std::function<void(response_parts &&)>;
+        using result_cb = unique_function<void(const json &)>;
+        using error_cb = unique_function<void(const json &)>;
+        using progress_cb = unique_function<void(const json &)>;
+        using clock = std::chrono::steady_clock;
+        // Per-call timeout: nullopt uses endpoint_options::default_timeout, zero disables
+        using timeout_t = std::optional<std::chrono::milliseconds>;
 
-        explicit endpoint(send_fn sender) : send_(std::move(sender))
+        explicit endpoint(send_fn sender, endpoint_options options = {})
+            : send_(std::move(sender)), options_(options)
         {
             // Register built-in notifications
             disp_.add("$/cancelRequest",
@@ -491,82 +2889,156 @@ namespace pooriayousefi
                       });
         }
 
-        // Server registration: wrap to enable context in handlers
+        // Server registration. Handlers are stored as-is; the call context is installed
+        // once per incoming request rather than by a per-handler wrapper.
         void add(const std::string &method, dispatcher::handler_t fn)
         {
-            disp_.add(
-                method,
-                [this, fn = std::move(fn)](const json &params) -> json
-                {
-                    // Build a context hooked into this endpoint
-                    json id = current_req_id_.value_or(nullptr);
-                    auto id_key = key_for_id(id);
-                    auto cancel_flag = server_cancels_[id_key];
-                    if (!cancel_flag)
-                        cancel_flag =
-                            (server_cancels_[id_key] = std::make_shared<std::atomic_bool>(false));
-
-                    // Determine progress token: either from params.progressToken or fallback to
-                    // id key
-                    std::string token;
-                    if (params.is_object() && params.contains("progressToken") &&
-                        params["progressToken"].is_string())
-                    {
-                        token = params["progressToken"].get<std::string>();
-                    }
-                    else
-                    {
-                        token = id_key;
-                    }
+            disp_.add(method, std::move(fn));
+        }
 
-                    call_context ctx{
-                        id, [this, token](const json &value) { send_progress(token, value); },
-                        [cancel_flag]()
-                        { return cancel_flag && cancel_flag->load(std::memory_order_relaxed); }};
-                    detail::tls_ctx = &ctx;
-                    try
-                    {
-                        auto out = fn(params);
-                        detail::tls_ctx = nullptr;
-                        return out;
-                    }
-                    catch (...)
-                    {
-                        detail::tls_ctx = nullptr;
-                        throw;
-                    }
-                });
+        // Server registration for lazy handlers
+        void add_lazy(const std::string &method, dispatcher::lazy_handler_t fn)
+        {
+            disp_.add_lazy(method, std::move(fn));
+        }
+
+        // Server registration for asynchronous handlers. `fn(params)` returns an awaitable
+        // producing the result (typically task<json>); the response is sent when it completes,
+        // so the thread calling receive() is free while the handler is suspended. params stay
+        // alive until completion. Whoever resumes the handler must not race other calls into
+        // this endpoint.
+        template <typename F> void add_async(const std::string &method, F fn)
+        {
+            disp_.add(method,
+                      [this, fn = std::move(fn)](const json &params) mutable -> json
+                      {
+                          request_scope &rq = *serving_;
+                          auto call = std::make_unique<async_call>(*this, rq, params);
+                          detail::context_scope scope(&call->ctx);
+                          // If fn throws here, the request is answered synchronously as usual
+                          auto awaitable = fn(call->params);
+                          rq.deferred = true;
+                          if (call->batch)
+                              ++call->batch->outstanding;
+                          run_async(std::move(call), std::move(awaitable));
+                          return nullptr; // the response is sent by run_async
+                      });
         }
 
+        // Fix the server's method set (see dispatcher::freeze)
+        void freeze() { disp_.freeze(); }
+
         // Server registration with typed parameters and return type
-        template <typename ParamsT, typename ResultT>
-        void add_typed(const std::string &method, std::function<ResultT(ParamsT)> fn)
+        template <typename ParamsT, typename ResultT, typename F>
+        void add_typed(const std::string &method, F fn)
         {
-            // Wrap the typed function with the endpoint context
-            add(method, detail::make_typed_handler<ParamsT, ResultT>(std::move(fn)));
+            add(method, detail::make_typed_handler<ParamsT, ResultT, F>(std::move(fn)));
         }
 
         // Server registration with no parameters
-        template <typename ResultT>
-        void add_no_params(const std::string &method, std::function<ResultT()> fn)
+        template <typename ResultT, typename F>
+        void add_no_params(const std::string &method, F fn)
         {
-            add(method, detail::make_no_params_handler<ResultT>(std::move(fn)));
+            add(method, detail::make_no_params_handler<ResultT, F>(std::move(fn)));
         }
 
-        // Client-side: send request (auto-generated id)
+        // Client-side: send request (auto-generated id). With numeric ids the returned string
+        // is the id in decimal. If no response arrives within the timeout, on_error receives
+        // request_timeout (see poll()).
         std::string send_request(const std::string &method, const json &params, result_cb on_result,
-                                 error_cb on_error)
+                                 error_cb on_error, timeout_t timeout = std::nullopt)
         {
+            if (options_.numeric_ids)
+            {
+                std::uint64_t id = ++numeric_id_counter_;
+                add_pending(id, pending_call{std::move(on_result), std::move(on_error)}, timeout);
+                send_outgoing(make_request(id, method, params));
+                return std::to_string(id);
+            }
             std::string id = gen_id();
-            pending_[id] = {std::move(on_result), std::move(on_error)};
-            send_(make_request(id, method, params));
+            add_pending(id, pending_call{std::move(on_result), std::move(on_error)}, timeout);
+            send_outgoing(make_request(id, method, params));
             return id;
         }
 
+        // Awaitable returned by call(). The request is sent when the call is awaited and the
+        // awaiting coroutine resumes with the result, or an rpc_exception carrying the error
+        // (request_cancelled after cancel(id())).
+        template <typename R> class call_op : detail::call_waiter
+        {
+          public:
+            // Request id, usable with cancel() before and while the call is awaited
+            const json &id() const { return id_; }
+
+            bool await_ready() const noexcept { return false; }
+
+            // A response that arrives inline, during the send, is not resumed into: the caller
+            // carries on when false is returned, so back-to-back calls don't nest on the stack
+            bool await_suspend(std::coroutine_handle<> h)
+            {
+                handle = h;
+                ep_.add_pending(id_, pending_call{nullptr, nullptr, this}, timeout_);
+                sending = true;
+                try
+                {
+                    ep_.send_outgoing(std::move(request_));
+                }
+                catch (...)
+                {
+                    sending = false;
+                    if (!completed)
+                        ep_.take_pending(id_);
+                    throw;
+                }
+                sending = false;
+                return !completed;
+            }
+
+            R await_resume()
+            {
+                if (!result)
+                    throw rpc_exception(detail::error_from_object(error));
+                if constexpr (std::is_void_v<R>)
+                    return;
+                else if constexpr (std::is_same_v<R, json>)
+                    return std::move(*result);
+                else
+                    return detail::deserialize_params<R>(*result);
+            }
+
+          private:
+            friend class endpoint;
+            call_op(endpoint &ep, json id, json request, timeout_t timeout)
+                : ep_(ep), id_(std::move(id)), request_(std::move(request)), timeout_(timeout)
+            {
+            }
+
+            endpoint &ep_;
+            json id_;
+            json request_;
+            timeout_t timeout_;
+        };
+
+        // Client-side: coroutine request, `R result = co_await ep.call<R>(method, params)`.
+        // The pending entry refers to the suspended coroutine; no callbacks are allocated.
+        template <typename R = json, typename ParamsT = json>
+        call_op<R> call(const std::string &method, const ParamsT &params = ParamsT{},
+                        timeout_t timeout = std::nullopt)
+        {
+            json id = next_request_id();
+            json request;
+            if constexpr (std::is_same_v<ParamsT, json>)
+                request = make_request(nullptr, method, params);
+            else
+                request = make_request(nullptr, method, detail::serialize_params(params));
+            request["id"] = id;
+            return call_op<R>(*this, std::move(id), std::move(request), timeout);
+        }
+
         // Client-side: send typed request with automatic serialization/deserialization
         template <typename ParamsT, typename ResultT>
         std::string send_request_typed(const std::string &method, const ParamsT &params,
-                                       std::function<void(ResultT)> on_result,
+                                       unique_function<void(ResultT)> on_result,
                                        error_cb on_error = nullptr)
         {
             // Serialize params to JSON (wraps in array if needed)
@@ -588,16 +3060,17 @@ namespace pooriayousefi
 
         // Client-side: send request with explicit id (useful for testing/cancellation ordering)
         void send_request_with_id(const std::string &id, const std::string &method,
-                                  const json &params, result_cb on_result, error_cb on_error)
+                                  const json &params, result_cb on_result, error_cb on_error,
+                                  timeout_t timeout = std::nullopt)
         {
-            pending_[id] = {std::move(on_result), std::move(on_error)};
-            send_(make_request(id, method, params));
+            add_pending(id, pending_call{std::move(on_result), std::move(on_error)}, timeout);
+            send_outgoing(make_request(id, method, params));
         }
 
         // Client-side: notifications
         void send_notification(const std::string &method, const json &params = json{})
         {
-            send_(make_notification(method, params));
+            send_outgoing(make_notification(method, params));
         }
 
         // Client-side: typed notification
@@ -610,19 +3083,27 @@ namespace pooriayousefi
 
         // Progress helpers
         std::string create_progress_token() { return gen_id("tok-"); }
-        void on_progress(const std::string &token, std::function<void(const json &)> cb)
+        void on_progress(const std::string &token, progress_cb cb)
         {
             progress_handlers_[token] = std::move(cb);
         }
         void send_progress(const std::string &token, const json &value)
         {
-            send_(make_notification("$/progress", json{{"token", token}, {"value", value}}));
+            send_outgoing(
+                make_notification("$/progress", json{{"token", token}, {"value", value}}));
         }
 
-        // Cancellation
+        // Cancellation. A coroutine awaiting call() for this id resumes right away with
+        // request_cancelled; a late response is then ignored.
         void cancel(const json &id)
         {
-            send_(make_notification("$/cancelRequest", json{{"id", id}}));
+            send_outgoing(make_notification("$/cancelRequest", json{{"id", id}}));
+            pending_call *entry = find_pending(id);
+            if (!entry || !entry->waiter)
+                return;
+            auto *waiter = entry->waiter;
+            take_pending(id);
+            waiter->complete(std::nullopt, make_error_object(request_cancelled));
         }
 
         // Initialize convenience
@@ -631,41 +3112,273 @@ namespace pooriayousefi
             return send_request("initialize", params, std::move(on_result), std::move(on_error));
         }
 
+        // Send queued outgoing messages now (endpoint_options::batching): one message as-is,
+        // several as a JSON-RPC batch
+        void flush()
+        {
+            if (outbox_.empty())
+                return;
+            json out = outbox_.size() == 1 ? std::move(outbox_.front()) : json(std::move(outbox_));
+            outbox_.clear();
+            outbox_bytes_ = 0;
+            send_(std::move(out));
+        }
+
+        // Flush a batch whose window has passed and expire client requests whose deadline has
+        // passed. Call periodically from the event loop (timeouts have millisecond
+        // resolution); returns the number of requests expired.
+        std::size_t poll(clock::time_point now = clock::now())
+        {
+            if (!outbox_.empty() && now >= outbox_deadline_)
+                flush();
+            std::size_t expired = 0;
+            timeouts_.advance(now,
+                              [&](json id)
+                              {
+                                  auto taken = take_pending(id);
+                                  if (!taken)
+                                      return;
+                                  ++expired;
+                                  json err = make_error_object(request_timeout);
+                                  if (taken->waiter)
+                                      taken->waiter->complete(std::nullopt, std::move(err));
+                                  else if (taken->on_error)
+                                      taken->on_error(err);
+                              });
+            return expired;
+        }
+
+        // Number of client requests still waiting for a response
+        std::size_t pending_count() const { return pending_.size() + numeric_pending_.size(); }
+
         void set_server_capabilities(json caps) { server_capabilities_ = std::move(caps); }
+
+        // Route single responses to `fn` unrendered (transports that serialize with
+        // message_writer); batches and every other message still go through the send_fn
+        void set_response_sender(response_fn fn) { respond_ = std::move(fn); }
         bool is_initialized() const { return initialized_; }
 
         // Incoming single or batch message entrypoint
-        void receive(const json &msg)
+        void receive(const json &msg) { receive_impl(msg); }
+
+        // Same as above for a message the caller no longer needs; params and ids are moved
+        // through the dispatcher instead of being copied
+        void receive(json &&msg) { receive_impl(std::move(msg)); }
+
+        // Serialized message from a transport. Text that is not valid JSON is answered with
+        // parse_error, as the spec requires.
+        void receive_raw(std::string_view text)
+        {
+            std::string_view raw_id;
+            json msg = detail::parse_request(text, raw_id);
+            if (msg.is_discarded())
+            {
+                send_response(response_parts{nullptr, {}, parse_error});
+                return;
+            }
+            receive_impl(std::move(msg), raw_id);
+        }
+
+      private:
+        // Outstanding client request: callbacks, or the coroutine awaiting call()
+        struct pending_call
+        {
+            result_cb on_result;
+            error_cb on_error;
+            detail::call_waiter *waiter = nullptr;
+            detail::timer_wheel<json>::handle timer{};
+        };
+
+        // Responses of one batch; sent once the loop and every async member are done
+        struct pending_batch
+        {
+            std::vector<json> out;
+            std::size_t outstanding = 1; // the receive loop itself
+        };
+
+        // Request currently being dispatched by serve()
+        struct request_scope
+        {
+            const call_context *ctx = nullptr;
+            bool has_id = false;
+            std::string id_key;
+            std::string token; // params.progressToken, empty if absent
+            std::shared_ptr<pending_batch> batch;
+            bool deferred = false; // answered later by an async handler
+        };
+
+        // Publishes the request being served to add_async handlers; restores it on exit
+        struct serving_scope
+        {
+            serving_scope(endpoint &e, request_scope *rq)
+                : ep(e), prev(std::exchange(e.serving_, rq))
+            {
+            }
+            ~serving_scope() { ep.serving_ = prev; }
+            serving_scope(const serving_scope &) = delete;
+            serving_scope &operator=(const serving_scope &) = delete;
+
+            endpoint &ep;
+            request_scope *prev;
+        };
+
+        // State of an in-flight async request; owns its params and call context
+        struct async_call
+        {
+            struct progress_fn
+            {
+                async_call *call;
+                void operator()(const json &value) const
+                {
+                    call->ep.send_progress(call->token.empty() ? call->id_key : call->token,
+                                           value);
+                }
+            };
+            struct canceled_fn
+            {
+                async_call *call;
+                bool operator()() const { return call->ep.cancel_requested(call->id_key); }
+            };
+
+            async_call(endpoint &e, request_scope &rq, const json &p)
+                : ep(e), params(p), has_id(rq.has_id), id_key(rq.id_key), token(rq.token),
+                  batch(rq.batch), ctx{rq.ctx->id, progress, canceled}
+            {
+            }
+            async_call(const async_call &) = delete;
+            async_call &operator=(const async_call &) = delete;
+
+            endpoint &ep;
+            json params;
+            bool has_id;
+            std::string id_key;
+            std::string token;
+            std::shared_ptr<pending_batch> batch;
+            progress_fn progress{this};
+            canceled_fn canceled{this};
+            call_context ctx;
+        };
+
+        template <typename Awaitable>
+        static detail::detached_task run_async(std::unique_ptr<async_call> call, Awaitable aw)
+        {
+            std::optional<response_parts> resp;
+            try
+            {
+                json result = co_await std::move(aw);
+                if (call->has_id)
+                    resp = response_parts{call->ctx.id, std::move(result), std::nullopt};
+            }
+            catch (const rpc_exception &ex)
+            {
+                if (call->has_id)
+                    resp = response_parts{call->ctx.id, {}, ex.err};
+            }
+            catch (const std::exception &ex)
+            {
+                if (call->has_id)
+                {
+                    error e = internal_error;
+                    e.data = json{{"what", ex.what()}};
+                    resp = response_parts{call->ctx.id, {}, std::move(e)};
+                }
+            }
+            call->ep.finish_async(*call, std::move(resp));
+        }
+
+        void finish_async(const async_call &call, std::optional<response_parts> resp)
+        {
+            if (call.has_id)
+                server_cancels_.erase(call.id_key);
+            if (call.batch)
+            {
+                if (resp)
+                    call.batch->out.push_back(std::move(*resp).to_json());
+                complete_batch(*call.batch);
+            }
+            else if (resp)
+            {
+                send_response(std::move(*resp));
+            }
+        }
+
+        // Client messages go through the outbox when batching is enabled
+        void send_outgoing(json msg)
+        {
+            if (!options_.batching)
+            {
+                send_(std::move(msg));
+                return;
+            }
+            if (outbox_.empty())
+                outbox_deadline_ = clock::now() + options_.batch_window;
+            if (options_.batch_max_bytes != 0)
+                outbox_bytes_ += detail::serialized_size(msg) + 1; // + separator
+            outbox_.push_back(std::move(msg));
+            if (outbox_.size() >= options_.batch_max_messages ||
+                (options_.batch_max_bytes != 0 && outbox_bytes_ >= options_.batch_max_bytes))
+                flush();
+        }
+
+        // Responses are not delayed, but must not overtake queued notifications (progress)
+        void send_response(json msg)
+        {
+            flush();
+            send_(std::move(msg));
+        }
+
+        void send_response(response_parts r)
+        {
+            flush();
+            if (respond_)
+                respond_(std::move(r));
+            else
+                send_(std::move(r).to_json());
+        }
+
+        void complete_batch(pending_batch &batch)
+        {
+            if (--batch.outstanding == 0 && !batch.out.empty())
+                send_response(json(std::move(batch.out)));
+        }
+
+        bool cancel_requested(const std::string &id_key) const
+        {
+            auto it = server_cancels_.find(id_key);
+            return it != server_cancels_.end() && it->second &&
+                   it->second->load(std::memory_order_relaxed);
+        }
+
+        // `raw_id`: bytes of a single request's id in the text it was parsed from, if any
+        template <typename J> void receive_impl(J &&msg, std::string_view raw_id = {})
         {
             if (msg.is_array())
             {
                 if (msg.empty())
                 {
-                    send_(make_error(nullptr, invalid_request));
+                    send_response(response_parts{nullptr, {}, invalid_request});
                     return;
                 }
-                std::vector<json> outs;
-                outs.reserve(msg.size());
-                for (const auto &m : msg)
-                {
-                    // Gather responses but do not emit immediately
-                    std::optional<json> id_opt = m.contains("id")
-                                                     ? std::optional<json>(m["id"])
-                                                     : std::optional<json>(json(nullptr));
-                    current_req_id_ = id_opt;
-                    auto r = disp_.handle_single(m);
-                    current_req_id_.reset();
-                    if (r)
-                        outs.push_back(*r);
-                    // Clean up cancellation flag for requests
-                    if (m.contains("id"))
+                // Gather responses but do not emit immediately
+                auto batch = std::make_shared<pending_batch>();
+                batch->out.reserve(msg.size());
+                for (auto &m : msg)
+                {
+                    // Replies to a batch we sent come back as an array of responses
+                    if (is_response(m))
                     {
-                        auto id_key = key_for_id(m["id"]);
-                        server_cancels_.erase(id_key);
+                        handle_incoming_response(m);
+                        continue;
                     }
+                    std::optional<response_parts> r;
+                    if constexpr (std::is_lvalue_reference_v<J>)
+                        r = serve(m, batch);
+                    else
+                        r = serve(std::move(m), batch);
+                    if (r)
+                        batch->out.push_back(std::move(*r).to_json());
                 }
-                if (!outs.empty())
-                    send_(json(outs));
+                complete_batch(*batch);
                 return;
             }
             if (is_response(msg))
@@ -674,28 +3387,55 @@ namespace pooriayousefi
                 return;
             }
             // Request/notification path
-            std::optional<json> id_opt;
-            if (msg.contains("id"))
-                id_opt = msg["id"];
-            else
-                id_opt = json(nullptr);
-            // Set current id for context
-            current_req_id_ = id_opt;
-            auto resp = disp_.handle_single(msg);
-            current_req_id_.reset();
+            auto resp = serve(std::forward<J>(msg), nullptr, raw_id);
             if (resp)
+                send_response(std::move(*resp));
+        }
+
+        // Dispatch one request/notification with a call_context hooked into this endpoint
+        // installed for the handler
+        template <typename J>
+        std::optional<response_parts> serve(J &&m, std::shared_ptr<pending_batch> batch = nullptr,
+                                            std::string_view raw_id = {})
+        {
+            request_scope rq;
+            rq.batch = std::move(batch);
+            rq.has_id = m.is_object() && m.contains("id");
+            json id = rq.has_id ? m["id"] : json(nullptr);
+            rq.id_key = rq.has_id ? key_for_id(id) : std::string("null");
+
+            // Progress token: params.progressToken if present, otherwise the id key. Read before
+            // dispatch since the params may be moved into the handler.
+            if (auto p = m.find("params"); p != m.end() && p->is_object())
             {
-                send_(*resp);
-                // Clean up cancellation flag for completed request
-                if (msg.contains("id"))
-                {
-                    auto id_key = key_for_id(msg["id"]);
-                    server_cancels_.erase(id_key);
-                }
+                auto t = p->find("progressToken");
+                if (t != p->end() && t->is_string())
+                    rq.token = t->template get<std::string>();
+            }
+
+            auto progress = [&](const json &value)
+            { send_progress(rq.token.empty() ? rq.id_key : rq.token, value); };
+            auto canceled = [&] { return cancel_requested(rq.id_key); };
+            call_context ctx{std::move(id), progress, canceled};
+            rq.ctx = &ctx;
+            std::optional<response_parts> r;
+            {
+                detail::context_scope scope(&ctx);
+                serving_scope serving(*this, &rq);
+                r = disp_.handle_single_parts(std::forward<J>(m));
             }
+            if (rq.deferred)
+                return std::nullopt; // an async handler owns the request now
+            // Clean up cancellation flag for completed request
+            if (rq.has_id)
+                server_cancels_.erase(rq.id_key);
+            // A null id in the response means the request's own id was not echoed
+            if (r && !r->id.is_null())
+                r->raw_id = raw_id;
+            return r;
         }
 
-      private:
+
         // Helper: normalize id into string key
         static std::string key_for_id(const json &id)
         {
@@ -707,40 +3447,111 @@ namespace pooriayousefi
         // Incoming responses
         void handle_incoming_response(const json &r)
         {
-            std::string key = key_for_id(r.at("id"));
-            auto it = pending_.find(key);
-            if (it == pending_.end())
+            auto taken = take_pending(r.at("id"));
+            if (!taken)
                 return; // unknown/late
-            auto [on_ok, on_err] = it->second;
-            pending_.erase(it);
+            pending_call &entry = *taken;
+            if (entry.waiter)
+            {
+                if (r.contains("result"))
+                    entry.waiter->complete(std::optional<json>(std::in_place, r["result"]),
+                                           nullptr);
+                else
+                    entry.waiter->complete(std::nullopt, r.value("error", json{}));
+                return;
+            }
             if (r.contains("result"))
             {
-                if (on_ok)
-                    on_ok(r["result"]);
+                if (entry.on_result)
+                    entry.on_result(r["result"]);
             }
             else if (r.contains("error"))
             {
-                if (on_err)
-                    on_err(r["error"]);
+                if (entry.on_error)
+                    entry.on_error(r["error"]);
             }
         }
 
-        std::string gen_id(const std::string &prefix = "req-")
+        std::string gen_id(std::string_view prefix = "req-")
+        {
+            char digits[24];
+            char *end = std::to_chars(digits, digits + sizeof(digits), ++id_counter_).ptr;
+            std::string id;
+            id.reserve(prefix.size() + static_cast<std::size_t>(end - digits));
+            id.append(prefix).append(digits, end);
+            return id;
+        }
+
+        json next_request_id()
+        {
+            if (options_.numeric_ids)
+                return ++numeric_id_counter_;
+            return gen_id();
+        }
+
+        // Numeric-id table entry for `id`, if it is one of ours
+        static std::optional<std::uint64_t> numeric_key(const json &id)
+        {
+            if (id.is_number_unsigned())
+                return id.get<std::uint64_t>();
+            if (id.is_number_integer() && id.get<std::int64_t>() > 0)
+                return static_cast<std::uint64_t>(id.get<std::int64_t>());
+            return std::nullopt;
+        }
+
+        void add_pending(const json &id, pending_call entry, timeout_t timeout)
+        {
+            auto limit = timeout.value_or(options_.default_timeout);
+            if (limit.count() > 0)
+                entry.timer = timeouts_.schedule(clock::now() + limit, id);
+            if (auto n = options_.numeric_ids ? numeric_key(id) : std::nullopt)
+                numeric_pending_.insert(*n, std::move(entry));
+            else
+                pending_[key_for_id(id)] = std::move(entry);
+        }
+
+        pending_call *find_pending(const json &id)
+        {
+            if (auto n = options_.numeric_ids ? numeric_key(id) : std::nullopt)
+                return numeric_pending_.find(*n);
+            auto it = pending_.find(key_for_id(id));
+            return it != pending_.end() ? &it->second : nullptr;
+        }
+
+        std::optional<pending_call> take_pending(const json &id)
         {
-            std::ostringstream oss;
-            oss << prefix << (++id_counter_);
-            return oss.str();
+            std::optional<pending_call> out;
+            if (auto n = options_.numeric_ids ? numeric_key(id) : std::nullopt)
+            {
+                out = numeric_pending_.take(*n);
+            }
+            else if (auto it = pending_.find(key_for_id(id)); it != pending_.end())
+            {
+                out.emplace(std::move(it->second));
+                pending_.erase(it);
+            }
+            if (out && out->timer)
+                timeouts_.cancel(out->timer);
+            return out;
         }
 
         send_fn send_;
+        response_fn respond_; // set_response_sender
         dispatcher disp_;
-        std::map<std::string, std::pair<result_cb, error_cb>> pending_;
+        std::map<std::string, pending_call> pending_;
+        detail::id_slot_table<pending_call> numeric_pending_; // endpoint_options::numeric_ids
+        detail::timer_wheel<json> timeouts_;                  // payload: request id
+        std::vector<json> outbox_;                            // endpoint_options::batching
+        std::size_t outbox_bytes_ = 0;
+        clock::time_point outbox_deadline_;
         std::unordered_map<std::string, std::shared_ptr<std::atomic_bool>> server_cancels_;
-        std::unordered_map<std::string, std::function<void(const json &)>> progress_handlers_;
-        std::optional<json> current_req_id_;
+        std::unordered_map<std::string, progress_cb> progress_handlers_;
+        request_scope *serving_ = nullptr;
         json server_capabilities_ = json::object();
         bool initialized_ = false;
         size_t id_counter_ = 0;
+        std::uint64_t numeric_id_counter_ = 0;
+        endpoint_options options_;
     };
 
 } // namespace pooriayousefi
@@ -0,0 +1,406 @@
+#pragma once
+
+#include "jsonrpc.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSONRPC_X86_SIMD 1
+#endif
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Message framing for stream transports. A codec turns a byte stream into whole JSON-RPC
+// messages and back:
+//   template <typename F> bool decode(std::string_view bytes, F &&on_message);
+//       calls on_message(std::string_view) for each complete message; false on a framing
+//       error (the connection should be closed)
+//   void encode(const json &msg, std::string &out);   appends one framed message
+// and may also take single responses unrendered (see endpoint::set_response_sender):
+//   void encode(const response_parts &r, std::string &out);
+// A codec that also writes replies of its own (HTTP status responses) may provide
+//   void attach(std::string &out);   the connection's output buffer, given once
+
+namespace pooriayousefi
+{
+
+    namespace detail
+    {
+        // Case-insensitive comparison for header names and tokens
+        inline bool ascii_iequals(std::string_view a, std::string_view b)
+        {
+            auto lower = [](char c) { return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c; };
+            return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                              [&](char x, char y) { return lower(x) == lower(y); });
+        }
+
+        // Newline scanning for NDJSON. A kernel writes the offset of every '\n' in [p, p + n)
+        // to out (n <= newline_window) and returns the count. The vector kernels compare a
+        // whole block per instruction and peel the matches off a bitmask, so dense short
+        // lines cost no more than long ones.
+        inline constexpr std::size_t newline_window = 4096;
+        using newline_kernel = std::size_t (*)(const char *p, std::size_t n, std::uint16_t *out);
+
+        inline std::size_t scan_newlines_tail(const char *p, std::size_t i, std::size_t n,
+                                              std::uint16_t *out, std::size_t count)
+        {
+            for (; i < n; ++i)
+            {
+                out[count] = static_cast<std::uint16_t>(i); // kept only if it is a match
+                count += p[i] == '\n';
+            }
+            return count;
+        }
+
+        // Portable fallback: eight bytes per step (SWAR) on little-endian targets
+        inline std::size_t scan_newlines_scalar(const char *p, std::size_t n, std::uint16_t *out)
+        {
+            std::size_t count = 0;
+            std::size_t i = 0;
+            if constexpr (std::endian::native == std::endian::little)
+            {
+                constexpr std::uint64_t ones = 0x0101010101010101ull;
+                constexpr std::uint64_t low7 = 0x7f7f7f7f7f7f7f7full;
+                for (; i + 8 <= n; i += 8)
+                {
+                    std::uint64_t word;
+                    std::memcpy(&word, p + i, sizeof(word));
+                    std::uint64_t x = word ^ (ones * '\n'); // zero bytes where '\n' was
+                    std::uint64_t mask = ~(((x & low7) + low7) | x | low7);
+                    for (; mask; mask &= mask - 1)
+                        out[count++] = static_cast<std::uint16_t>(i + std::countr_zero(mask) / 8);
+                }
+            }
+            return scan_newlines_tail(p, i, n, out, count);
+        }
+
+#ifdef JSONRPC_X86_SIMD
+        // 64 bytes per step: one 64-bit mask, one branch for the common no-newline case
+        __attribute__((target("sse2"))) inline std::size_t
+        scan_newlines_sse2(const char *p, std::size_t n, std::uint16_t *out)
+        {
+            const __m128i nl = _mm_set1_epi8('\n');
+            auto match = [&](std::size_t at) -> std::uint64_t
+            {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + at));
+                return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, nl)));
+            };
+            std::size_t count = 0;
+            std::size_t i = 0;
+            for (; i + 64 <= n; i += 64)
+            {
+                std::uint64_t mask = match(i) | match(i + 16) << 16 | match(i + 32) << 32 |
+                                     match(i + 48) << 48;
+                for (; mask; mask &= mask - 1)
+                    out[count++] = static_cast<std::uint16_t>(i + std::countr_zero(mask));
+            }
+            return scan_newlines_tail(p, i, n, out, count);
+        }
+
+        __attribute__((target("avx2"))) inline std::size_t
+        scan_newlines_avx2(const char *p, std::size_t n, std::uint16_t *out)
+        {
+            const __m256i nl = _mm256_set1_epi8('\n');
+            auto match = [&](std::size_t at) __attribute__((target("avx2"))) -> std::uint64_t
+            {
+                __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + at));
+                return static_cast<std::uint32_t>(
+                    _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl)));
+            };
+            std::size_t count = 0;
+            std::size_t i = 0;
+            for (; i + 64 <= n; i += 64)
+            {
+                std::uint64_t mask = match(i) | match(i + 32) << 32;
+                for (; mask; mask &= mask - 1)
+                    out[count++] = static_cast<std::uint16_t>(i + std::countr_zero(mask));
+            }
+            return scan_newlines_tail(p, i, n, out, count);
+        }
+#endif
+
+        // Best kernel for this CPU, picked once
+        inline newline_kernel newline_scanner()
+        {
+            static const newline_kernel kernel = []
+            {
+#ifdef JSONRPC_X86_SIMD
+                if (__builtin_cpu_supports("avx2"))
+                    return scan_newlines_avx2;
+                if (__builtin_cpu_supports("sse2"))
+                    return scan_newlines_sse2;
+#endif
+                return scan_newlines_scalar;
+            }();
+            return kernel;
+        }
+    } // namespace detail
+
+    // Newline-delimited JSON: one message per line. Blank lines and a trailing '\r' are
+    // ignored. Boundaries are found with the vectorized scanner above; complete lines are
+    // handed out straight from the input buffer, and only the tail of a message split across
+    // reads is carried over (in a buffer that is reused, not reallocated).
+    class ndjson_codec
+    {
+      public:
+        explicit ndjson_codec(std::size_t max_message_size = 64 * 1024 * 1024)
+            : max_message_size_(max_message_size)
+        {
+        }
+
+        template <typename F> bool decode(std::string_view bytes, F &&on_message)
+        {
+            const detail::newline_kernel scan = detail::newline_scanner();
+            std::uint16_t lines[detail::newline_window];
+            const char *start = bytes.data(); // first byte of the current message
+            for (std::size_t base = 0; base < bytes.size(); base += detail::newline_window)
+            {
+                const char *window = bytes.data() + base;
+                std::size_t count =
+                    scan(window, std::min(detail::newline_window, bytes.size() - base), lines);
+                for (std::size_t k = 0; k < count; ++k)
+                {
+                    const char *nl = window + lines[k];
+                    std::string_view line(start, static_cast<std::size_t>(nl - start));
+                    start = nl + 1;
+                    if (partial_.empty())
+                    {
+                        if (line.size() > max_message_size_)
+                            return false;
+                        emit(line, on_message);
+                        continue;
+                    }
+                    partial_.append(line);
+                    if (partial_.size() > max_message_size_)
+                        return false;
+                    emit(partial_, on_message);
+                    partial_.clear(); // keeps its capacity for the next split message
+                }
+            }
+            partial_.append(start, static_cast<std::size_t>(bytes.data() + bytes.size() - start));
+            return partial_.size() <= max_message_size_;
+        }
+
+        void encode(const json &msg, std::string &out) { encode_message(msg, out); }
+        void encode(const response_parts &r, std::string &out) { encode_message(r, out); }
+
+        // No partial message buffered (end of input here is clean)
+        bool idle() const { return partial_.empty(); }
+
+      private:
+        template <typename F> static void emit(std::string_view line, F &on_message)
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            if (!line.empty())
+                on_message(line);
+        }
+
+        template <typename M> void encode_message(const M &msg, std::string &out)
+        {
+            writer_.write(out, msg);
+            out += '\n';
+        }
+
+        std::string partial_;
+        std::size_t max_message_size_;
+        message_writer writer_;
+    };
+
+    // LSP-style framing: "Content-Length: N\r\n" plus optional other headers, a blank line,
+    // then exactly N bytes of JSON. Parsing is incremental, so reads may split a message
+    // anywhere. A body that arrived whole in one read is handed out in place; otherwise it is
+    // assembled in a reusable buffer, which a reader can also fill directly (body_space /
+    // body_written) to skip the intermediate read buffer for large messages.
+    class content_length_codec
+    {
+      public:
+        static constexpr std::size_t max_header_size = 8 * 1024;
+        // "Content-Length: " + 20 digits + "\r\n\r\n"
+        static constexpr std::size_t header_capacity = 48;
+
+        explicit content_length_codec(std::size_t max_message_size = 64 * 1024 * 1024)
+            : max_message_size_(max_message_size)
+        {
+        }
+
+        template <typename F> bool decode(std::string_view bytes, F &&on_message)
+        {
+            while (!bytes.empty())
+            {
+                if (in_body_)
+                {
+                    std::size_t n = std::min(bytes.size(), body_length_ - body_filled_);
+                    if (body_filled_ == 0 && n == body_length_)
+                    {
+                        // Whole body in this read: no copy
+                        in_body_ = false;
+                        on_message(bytes.substr(0, n));
+                    }
+                    else
+                    {
+                        std::memcpy(body_.get() + body_filled_, bytes.data(), n);
+                        body_written(n, on_message);
+                    }
+                    bytes.remove_prefix(n);
+                    continue;
+                }
+                std::size_t used = 0;
+                if (!read_header(bytes, used))
+                    return false;
+                bytes.remove_prefix(used);
+                if (in_body_ && body_length_ == 0)
+                {
+                    in_body_ = false;
+                    on_message(std::string_view{});
+                }
+            }
+            return true;
+        }
+
+        // No partial message buffered
+        bool idle() const { return !in_body_ && header_.empty(); }
+
+        // Where the rest of the current body goes, or {nullptr, 0} outside a body
+        std::pair<char *, std::size_t> body_space()
+        {
+            if (!in_body_)
+                return {nullptr, 0};
+            return {body_.get() + body_filled_, body_length_ - body_filled_};
+        }
+
+        // n bytes were written at body_space(); emits the message once it is complete
+        template <typename F> void body_written(std::size_t n, F &&on_message)
+        {
+            body_filled_ += n;
+            if (body_filled_ == body_length_)
+            {
+                in_body_ = false;
+                on_message(std::string_view(body_.get(), body_length_));
+            }
+        }
+
+        void encode(const json &msg, std::string &out) { encode_message(msg, out); }
+        void encode(const response_parts &r, std::string &out) { encode_message(r, out); }
+
+        // Writes the header for a body of `length` bytes; returns its size
+        static std::size_t format_header(std::size_t length, char (&buf)[header_capacity])
+        {
+            constexpr std::string_view prefix = "Content-Length: ";
+            std::memcpy(buf, prefix.data(), prefix.size());
+            char *end = std::to_chars(buf + prefix.size(), buf + header_capacity - 4, length).ptr;
+            std::memcpy(end, "\r\n\r\n", 4);
+            return static_cast<std::size_t>(end + 4 - buf);
+        }
+
+      private:
+        // The body is serialized in place behind room for the longest header, then moved
+        // down against the real header once its length is known
+        template <typename M> void encode_message(const M &msg, std::string &out)
+        {
+            constexpr std::size_t room = 16 + 20 + 4;
+            std::size_t at = out.size();
+            out.append(room, '\0');
+            writer_.write(out, msg);
+            std::size_t length = out.size() - at - room;
+            char header[header_capacity];
+            std::size_t size = format_header(length, header);
+            std::memmove(out.data() + at + size, out.data() + at + room, length);
+            std::memcpy(out.data() + at, header, size);
+            out.resize(at + size + length);
+        }
+
+        // Consume header bytes; sets in_body_ once the blank line is seen. Only a header
+        // split across reads is copied.
+        bool read_header(std::string_view bytes, std::size_t &used)
+        {
+            std::string_view header;
+            if (header_.empty())
+            {
+                auto end = bytes.find("\r\n\r\n");
+                if (end == std::string_view::npos)
+                {
+                    header_.append(bytes);
+                    used = bytes.size();
+                    return header_.size() <= max_header_size;
+                }
+                if (end > max_header_size)
+                    return false;
+                header = bytes.substr(0, end);
+                used = end + 4;
+            }
+            else
+            {
+                // The terminator may straddle the previous read
+                std::size_t old = header_.size();
+                header_.append(bytes.substr(0, max_header_size + 4));
+                auto end = header_.find("\r\n\r\n", old < 3 ? 0 : old - 3);
+                if (end == std::string::npos)
+                {
+                    used = bytes.size();
+                    return header_.size() <= max_header_size;
+                }
+                used = end + 4 - old;
+                header_.resize(end);
+                header = header_;
+            }
+            bool ok = parse_header(header);
+            header_.clear();
+            return ok;
+        }
+
+        bool parse_header(std::string_view header)
+        {
+            bool found = false;
+            while (!header.empty())
+            {
+                auto eol = header.find("\r\n");
+                std::string_view line = header.substr(0, eol);
+                header.remove_prefix(eol == std::string_view::npos ? header.size() : eol + 2);
+                auto colon = line.find(':');
+                if (colon == std::string_view::npos)
+                    return false;
+                if (!detail::ascii_iequals(line.substr(0, colon), "Content-Length"))
+                    continue; // Content-Type and the like
+                std::string_view value = line.substr(colon + 1);
+                while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+                    value.remove_prefix(1);
+                while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+                    value.remove_suffix(1);
+                std::size_t length = 0;
+                auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), length);
+                if (ec != std::errc{} || ptr != value.data() + value.size() || value.empty())
+                    return false;
+                body_length_ = length;
+                found = true;
+            }
+            if (!found || body_length_ > max_message_size_)
+                return false;
+            if (body_length_ > body_capacity_)
+            {
+                body_.reset(new char[body_length_]);
+                body_capacity_ = body_length_;
+            }
+            body_filled_ = 0;
+            in_body_ = true;
+            return true;
+        }
+
+        std::string header_;
+        std::unique_ptr<char[]> body_;
+        std::size_t body_capacity_ = 0;
+        std::size_t body_length_ = 0;
+        std::size_t body_filled_ = 0;
+        bool in_body_ = false;
+        std::size_t max_message_size_;
+        message_writer writer_;
+    };
+
+} // namespace pooriayousefi
@@ -0,0 +1,881 @@
+#pragma once
+
+#include "jsonrpc.hpp"
+#include "jsonrpc_framing.hpp"
+#include "jsonrpc_tcp.hpp"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+// JSON-RPC over HTTP/1.1 POST: an http_codec for the TCP server (http_server) and a
+// pipelining client. Connections are kept alive; requests may be pipelined and are answered
+// in order; batch responses are streamed with chunked transfer encoding.
+
+namespace pooriayousefi
+{
+
+    namespace detail
+    {
+        // What the rest of the exchange needs from a message head
+        struct http_head
+        {
+            bool post = false; // request: method is POST
+            int status = 0;    // response: status code
+            bool keep_alive = true;
+            bool http_1_0 = false; // peer speaks HTTP/1.0: no chunked bodies
+            bool chunked = false;
+            std::size_t content_length = 0;
+        };
+
+        // Incremental HTTP/1.1 message parser (requests or responses). Heads are parsed in
+        // place when a read holds them whole; a head or chunk-size line split across reads,
+        // and a body split across reads or chunked, are assembled in buffers that keep their
+        // capacity, so a connection stops allocating once it has warmed up.
+        class http_parser
+        {
+          public:
+            static constexpr std::size_t max_head_size = 8 * 1024;
+
+            explicit http_parser(bool requests, std::size_t max_body_size)
+                : requests_(requests), max_body_size_(max_body_size)
+            {
+            }
+
+            // Calls on_message(const http_head &, std::string_view body) for each complete
+            // message; false on a malformed stream
+            template <typename F> bool feed(std::string_view bytes, F &&on_message)
+            {
+                for (;;)
+                {
+                    std::string_view line;
+                    switch (state_)
+                    {
+                    case state::head:
+                    {
+                        if (bytes.empty())
+                            return true;
+                        std::string_view head;
+                        if (!take_head(bytes, head))
+                            return line_.size() <= max_head_size;
+                        bool ok = parse_head(head);
+                        line_.clear();
+                        if (!ok)
+                            return false;
+                        if (!requests_ && (head_.status / 100 == 1))
+                            continue; // interim response (100 Continue): the real one follows
+                        body_.clear();
+                        if (head_.chunked)
+                            state_ = state::chunk_size;
+                        else if (head_.content_length > max_body_size_)
+                            return false;
+                        else if (head_.content_length > 0 && !no_body())
+                        {
+                            state_ = state::body;
+                            remaining_ = head_.content_length;
+                        }
+                        else
+                        {
+                            on_message(head_, std::string_view());
+                        }
+                        continue;
+                    }
+                    case state::body:
+                    {
+                        if (body_.empty() && bytes.size() >= remaining_)
+                        {
+                            // Whole body in this read: hand it out in place
+                            std::string_view body = bytes.substr(0, remaining_);
+                            bytes.remove_prefix(remaining_);
+                            state_ = state::head;
+                            on_message(head_, body);
+                            continue;
+                        }
+                        std::size_t take = std::min(remaining_, bytes.size());
+                        body_.append(bytes.data(), take);
+                        bytes.remove_prefix(take);
+                        remaining_ -= take;
+                        if (remaining_ != 0)
+                            return true;
+                        state_ = state::head;
+                        on_message(head_, std::string_view(body_));
+                        continue;
+                    }
+                    case state::chunk_size:
+                    {
+                        if (!take_line(bytes, line))
+                            return line_.size() <= max_head_size;
+                        line = line.substr(0, line.find(';')); // chunk extensions are ignored
+                        std::size_t size = 0;
+                        auto [end, ec] =
+                            std::from_chars(line.data(), line.data() + line.size(), size, 16);
+                        line_.clear();
+                        if (ec != std::errc() || end == line.data() ||
+                            size > max_body_size_ - body_.size())
+                            return false;
+                        remaining_ = size;
+                        state_ = size == 0 ? state::trailer : state::chunk_data;
+                        continue;
+                    }
+                    case state::chunk_data:
+                    {
+                        std::size_t take = std::min(remaining_, bytes.size());
+                        body_.append(bytes.data(), take);
+                        bytes.remove_prefix(take);
+                        remaining_ -= take;
+                        if (remaining_ != 0)
+                            return true;
+                        state_ = state::chunk_end;
+                        continue;
+                    }
+                    case state::chunk_end:
+                    {
+                        if (!take_line(bytes, line))
+                            return line_.size() <= 2;
+                        bool empty = line.empty();
+                        line_.clear();
+                        if (!empty)
+                            return false;
+                        state_ = state::chunk_size;
+                        continue;
+                    }
+                    case state::trailer:
+                    {
+                        if (!take_line(bytes, line))
+                            return line_.size() <= max_head_size;
+                        bool last = line.empty();
+                        line_.clear();
+                        if (last)
+                        {
+                            state_ = state::head;
+                            on_message(head_, std::string_view(body_));
+                        }
+                        continue;
+                    }
+                    }
+                }
+            }
+
+            // Between messages (end of input here is clean)
+            bool idle() const { return state_ == state::head && line_.empty(); }
+
+          private:
+            enum class state
+            {
+                head,
+                body,
+                chunk_size,
+                chunk_data,
+                chunk_end,
+                trailer
+            };
+
+            bool no_body() const
+            {
+                return !requests_ && (head_.status == 204 || head_.status == 304);
+            }
+
+            // Up to and including the blank line; false (bytes kept) if it isn't complete yet
+            bool take_head(std::string_view &bytes, std::string_view &head)
+            {
+                if (line_.empty())
+                {
+                    std::size_t end = bytes.find("\r\n\r\n");
+                    if (end != std::string_view::npos)
+                    {
+                        head = bytes.substr(0, end + 4);
+                        bytes.remove_prefix(end + 4);
+                        return true;
+                    }
+                    line_.assign(bytes);
+                    bytes = {};
+                    return false;
+                }
+                // The terminator may straddle the reads
+                std::size_t old = line_.size();
+                line_.append(bytes.data(), std::min(bytes.size(), max_head_size + 4));
+                std::size_t end = line_.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+                if (end == std::string::npos)
+                {
+                    bytes = {};
+                    return false;
+                }
+                bytes.remove_prefix(end + 4 - old);
+                line_.resize(end + 4);
+                head = line_;
+                return true;
+            }
+
+            // One CRLF-terminated line without its terminator; false if it isn't complete yet
+            bool take_line(std::string_view &bytes, std::string_view &line)
+            {
+                std::size_t nl = bytes.find('\n');
+                if (nl == std::string_view::npos)
+                {
+                    line_.append(bytes.data(), std::min(bytes.size(), max_head_size + 1));
+                    bytes = {};
+                    return false;
+                }
+                if (line_.empty())
+                {
+                    line = bytes.substr(0, nl);
+                }
+                else
+                {
+                    line_.append(bytes.data(), nl);
+                    line = line_;
+                }
+                bytes.remove_prefix(nl + 1);
+                if (!line.empty() && line.back() == '\r')
+                    line.remove_suffix(1);
+                return true;
+            }
+
+            bool parse_head(std::string_view head)
+            {
+                head_ = http_head{};
+                bool has_length = false;
+                std::size_t eol = head.find("\r\n");
+                std::string_view start = head.substr(0, eol);
+                head.remove_prefix(eol + 2);
+
+                std::string_view version;
+                if (requests_)
+                {
+                    // METHOD SP target SP HTTP/1.x
+                    std::size_t sp = start.find(' ');
+                    std::size_t last = start.rfind(' ');
+                    if (sp == std::string_view::npos || last == sp)
+                        return false;
+                    head_.post = start.substr(0, sp) == "POST";
+                    version = start.substr(last + 1);
+                }
+                else
+                {
+                    // HTTP/1.x SP status SP reason
+                    std::size_t sp = start.find(' ');
+                    if (sp == std::string_view::npos || start.size() < sp + 4)
+                        return false;
+                    version = start.substr(0, sp);
+                    auto [end, ec] = std::from_chars(start.data() + sp + 1,
+                                                     start.data() + sp + 4, head_.status);
+                    if (ec != std::errc() || end != start.data() + sp + 4)
+                        return false;
+                }
+                if (version.substr(0, 7) != "HTTP/1.")
+                    return false;
+                head_.http_1_0 = version == "HTTP/1.0";
+                head_.keep_alive = !head_.http_1_0;
+
+                while (!head.empty())
+                {
+                    eol = head.find("\r\n");
+                    std::string_view field = head.substr(0, eol);
+                    head.remove_prefix(eol + 2);
+                    if (field.empty())
+                        break;
+                    std::size_t colon = field.find(':');
+                    if (colon == std::string_view::npos)
+                        return false;
+                    std::string_view name = field.substr(0, colon);
+                    std::string_view value = trim(field.substr(colon + 1));
+                    if (ascii_iequals(name, "Content-Length"))
+                    {
+                        std::size_t length = 0;
+                        auto [end, ec] =
+                            std::from_chars(value.data(), value.data() + value.size(), length);
+                        if (ec != std::errc() || end != value.data() + value.size() ||
+                            (has_length && length != head_.content_length))
+                            return false;
+                        head_.content_length = length;
+                        has_length = true;
+                    }
+                    else if (ascii_iequals(name, "Transfer-Encoding"))
+                    {
+                        head_.chunked = value.size() >= 7 &&
+                                        ascii_iequals(value.substr(value.size() - 7), "chunked");
+                    }
+                    else if (ascii_iequals(name, "Connection"))
+                    {
+                        if (ascii_iequals(value, "close"))
+                            head_.keep_alive = false;
+                        else if (ascii_iequals(value, "keep-alive"))
+                            head_.keep_alive = true;
+                    }
+                }
+                return true;
+            }
+
+            static std::string_view trim(std::string_view s)
+            {
+                while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+                    s.remove_prefix(1);
+                while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+                    s.remove_suffix(1);
+                return s;
+            }
+
+            bool requests_;
+            std::size_t max_body_size_;
+            state state_ = state::head;
+            http_head head_;
+            std::string line_; // head or line split across reads
+            std::string body_; // body split across reads, or de-chunked
+            std::size_t remaining_ = 0;
+        };
+
+        // Writes a message body behind a head that ends just before its Content-Length field.
+        // The field is written with room for any length and the body serialized straight
+        // behind it; the digits are filled in afterwards and the unused room is left as
+        // trailing whitespace, which HTTP allows around a field value.
+        class http_body_writer
+        {
+          public:
+            explicit http_body_writer(std::string &out) : out_(out) {}
+
+            std::string &buffer() const { return out_; }
+
+            template <typename M> void write(const M &msg)
+            {
+                static constexpr std::string_view field = "Content-Length: "
+                                                          "                    \r\n\r\n";
+                out_ += field;
+                std::size_t body = out_.size();
+                writer_.write(out_, msg);
+                char *digits = out_.data() + body - field.size() + 16;
+                std::to_chars(digits, digits + 20, out_.size() - body);
+            }
+
+          private:
+            std::string &out_;
+            message_writer writer_;
+        };
+
+        // Serializer output that frames what it is given as HTTP chunks, in place: each chunk
+        // starts with a fixed-width (zero-padded) hex size that is patched once it is full
+        struct http_chunked_output : nlohmann::detail::output_adapter_protocol<char>
+        {
+            static constexpr std::size_t chunk_size = 16 * 1024;
+            static constexpr std::size_t size_width = 8;
+
+            explicit http_chunked_output(std::string &o) : out(o) { open(); }
+
+            void write_character(char c) override
+            {
+                out.push_back(c);
+                if (out.size() - data_start() >= chunk_size)
+                    next();
+            }
+
+            void write_characters(const char *s, std::size_t length) override
+            {
+                while (length > 0)
+                {
+                    std::size_t take = std::min(length, chunk_size - (out.size() - data_start()));
+                    out.append(s, take);
+                    s += take;
+                    length -= take;
+                    if (out.size() - data_start() >= chunk_size)
+                        next();
+                }
+            }
+
+            // Close the last chunk and write the terminating zero-size chunk
+            void finish()
+            {
+                close();
+                out += "0\r\n\r\n";
+            }
+
+          private:
+            std::size_t data_start() const { return start + size_width + 2; }
+
+            void open()
+            {
+                start = out.size();
+                out.append(size_width, '0');
+                out += "\r\n";
+            }
+
+            void close()
+            {
+                std::size_t size = out.size() - data_start();
+                if (size == 0)
+                {
+                    out.resize(start);
+                    return;
+                }
+                static constexpr char hex[] = "0123456789abcdef";
+                for (std::size_t i = 0; i < size_width; ++i, size >>= 4)
+                    out[start + size_width - 1 - i] = hex[size & 15];
+                out += "\r\n";
+            }
+
+            void next()
+            {
+                close();
+                open();
+            }
+
+            std::string &out;
+            std::size_t start = 0;
+        };
+
+        // Blocking connect to host:port (name or address), with TCP_NODELAY set
+        inline int tcp_connect(const std::string &host, std::uint16_t port)
+        {
+            addrinfo hints{};
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo *found = nullptr;
+            int rc = ::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found);
+            if (rc != 0)
+                throw std::system_error(EHOSTUNREACH, std::generic_category(), gai_strerror(rc));
+            int err = ECONNREFUSED;
+            int fd = -1;
+            for (addrinfo *a = found; a && fd < 0; a = a->ai_next)
+            {
+                fd = ::socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+                if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0)
+                {
+                    err = errno;
+                    ::close(fd);
+                    fd = -1;
+                }
+            }
+            ::freeaddrinfo(found);
+            if (fd < 0)
+                throw std::system_error(err, std::generic_category(), "connect " + host);
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return fd;
+        }
+    } // namespace detail
+
+    // Server side of JSON-RPC over HTTP, for basic_tcp_server (see http_server). Each POST
+    // body goes to the connection's endpoint; the response it produces becomes the HTTP
+    // response (200), a request that produces none (notifications) gets 204. Responses go out
+    // in request order: a request answered later by an async handler holds its place in the
+    // pipeline, and responses to the requests behind it wait until it has been answered.
+    // Anything else the endpoint sends, such as server-initiated notifications, has no HTTP
+    // exchange to travel in and is dropped. After a request with "Connection: close" (or an
+    // HTTP/1.0 request without keep-alive) has been answered, the connection is closed.
+    class http_codec
+    {
+      public:
+        explicit http_codec(std::size_t max_message_size = 64 * 1024 * 1024)
+            : parser_(true, max_message_size)
+        {
+        }
+
+        void attach(std::string &out) { out_ = &out; }
+
+        // False once the connection should be closed after its output is written
+        template <typename F> bool decode(std::string_view bytes, F &&on_message)
+        {
+            bool ok = parser_.feed(bytes,
+                                   [&](const detail::http_head &head, std::string_view body)
+                                   {
+                                       if (closing_)
+                                           return; // pipelined behind Connection: close
+                                       current_ = exchange{head.keep_alive, head.http_1_0};
+                                       closing_ = !head.keep_alive;
+                                       if (!head.post)
+                                       {
+                                           reply_status("405 Method Not Allowed",
+                                                        "Allow: POST\r\n");
+                                           return;
+                                       }
+                                       in_request_ = true;
+                                       answered_ = false;
+                                       on_message(body);
+                                       in_request_ = false;
+                                       if (!answered_ && !defer(body))
+                                           reply_status("204 No Content", "");
+                                   });
+            if (!ok && !closing_)
+            {
+                current_ = exchange{false, false};
+                closing_ = true;
+                reply_status("400 Bad Request", "");
+                return false;
+            }
+            return !finished();
+        }
+
+        // Every response owed on a closing connection has been written
+        bool finished() const { return closing_ && pipeline_.empty(); }
+
+        // Memory held by responses queued behind one still owed, and by the slots themselves.
+        // The server counts it with its unsent output (max_pending_output), so a peer that
+        // pipelines behind a slow request is no longer read.
+        std::size_t pending_output() const { return queued_ + pipeline_.size() * sizeof(slot); }
+
+        // Only responses to requests of this connection are sent
+        void encode(const json &msg, std::string &out)
+        {
+            if (!msg.is_array() && !msg.contains("result") && !msg.contains("error"))
+                return;
+            respond(msg, out);
+        }
+
+        // A single response, written without building its envelope
+        void encode(const response_parts &r, std::string &out) { respond(r, out); }
+
+      private:
+        // What the response to a request must honour
+        struct exchange
+        {
+            bool keep_alive = true;
+            bool http_1_0 = false;
+        };
+
+        // A response that cannot be written to the output yet: either still owed by an async
+        // handler (ids non-empty, not ready) or rendered and queued behind one
+        struct slot
+        {
+            exchange ex;
+            std::vector<json> ids;
+            std::string bytes;
+            bool ready = false;
+        };
+
+        template <typename M> void respond(const M &msg, std::string &out)
+        {
+            // A late response fills the slot of the request it answers
+            for (auto &s : pipeline_)
+            {
+                if (!s.ready && answers(msg, s.ids))
+                {
+                    queued_ -= s.ids.size() * sizeof(json);
+                    s.ids.clear();
+                    write_response(msg, s.ex, s.bytes);
+                    queued_ += s.bytes.size();
+                    s.ready = true;
+                    release(out);
+                    return;
+                }
+            }
+            if (!in_request_ || answered_)
+                return;
+            answered_ = true;
+            std::string &to = target(out);
+            write_response(msg, current_, to);
+            held(to, out);
+        }
+
+        template <typename M>
+        void write_response(const M &msg, const exchange &ex, std::string &out)
+        {
+            out += "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n";
+            out += connection_field(ex);
+            if constexpr (std::is_same_v<M, json>)
+            {
+                if (msg.is_array() && !ex.http_1_0)
+                {
+                    // Batches can be large: stream them in chunks instead of sizing them first
+                    out += "Transfer-Encoding: chunked\r\n\r\n";
+                    auto chunks = std::make_shared<detail::http_chunked_output>(out);
+                    nlohmann::detail::serializer<json>(chunks, ' ').dump(msg, false, false, 0);
+                    chunks->finish();
+                    return;
+                }
+            }
+            if (!writer_ || &writer_->buffer() != &out)
+                writer_ = std::make_unique<detail::http_body_writer>(out);
+            writer_->write(msg);
+        }
+
+        void reply_status(std::string_view status, std::string_view headers)
+        {
+            if (!out_)
+                return;
+            std::string &out = target(*out_);
+            out += "HTTP/1.1 ";
+            out += status;
+            out += "\r\n";
+            out += headers;
+            out += connection_field(current_);
+            out += "Content-Length: 0\r\n\r\n";
+            held(out, *out_);
+        }
+
+        static std::string_view connection_field(const exchange &ex)
+        {
+            if (!ex.keep_alive)
+                return "Connection: close\r\n";
+            if (ex.http_1_0)
+                return "Connection: keep-alive\r\n"; // HTTP/1.0 closes unless told otherwise
+            return {};
+        }
+
+        // Where the response to the current request goes: straight to the output unless
+        // earlier responses are still owed
+        std::string &target(std::string &out)
+        {
+            if (pipeline_.empty())
+                return out;
+            pipeline_.push_back(slot{current_, {}, {}, true});
+            return pipeline_.back().bytes;
+        }
+
+        // Count a response that target() put in a slot instead of the output
+        void held(const std::string &written, const std::string &out)
+        {
+            if (&written != &out)
+                queued_ += written.size();
+        }
+
+        // A request with an id that got no response is owed one by an async handler: hold
+        // its place. Only then is the body scanned again, for the ids to match it by.
+        bool defer(std::string_view body)
+        {
+            std::vector<json> ids = request_ids(body);
+            if (ids.empty())
+                return false;
+            queued_ += ids.size() * sizeof(json);
+            pipeline_.push_back(slot{current_, std::move(ids), {}, false});
+            return true;
+        }
+
+        void release(std::string &out)
+        {
+            while (!pipeline_.empty() && pipeline_.front().ready)
+            {
+                out += pipeline_.front().bytes;
+                queued_ -= pipeline_.front().bytes.size();
+                pipeline_.pop_front();
+            }
+        }
+
+        // Ids of the requests in `body` that expect a response
+        static std::vector<json> request_ids(std::string_view body)
+        {
+            auto unresolved = [](std::string_view) { return std::optional<std::uint32_t>(); };
+            std::vector<json> ids;
+            auto collect = [&](const detail::request_envelope &env)
+            {
+                if (env.is_object && env.method_ok && env.has_id && env.id_ok)
+                    ids.push_back(env.id);
+            };
+            detail::request_envelope env;
+            if (!detail::scan_envelope(body, env, unresolved))
+                return ids;
+            if (!env.is_batch)
+                collect(env);
+            for (const auto &member : env.members)
+                collect(member);
+            return ids;
+        }
+
+        static bool answers(const json &msg, const std::vector<json> &ids)
+        {
+            auto owed = [&ids](const json &response)
+            {
+                auto id = response.find("id");
+                return id != response.end() && std::find(ids.begin(), ids.end(), *id) != ids.end();
+            };
+            if (!msg.is_array())
+                return owed(msg);
+            return std::any_of(msg.begin(), msg.end(),
+                               [&](const json &r) { return r.is_object() && owed(r); });
+        }
+
+        static bool answers(const response_parts &r, const std::vector<json> &ids)
+        {
+            return std::find(ids.begin(), ids.end(), r.id) != ids.end();
+        }
+
+        detail::http_parser parser_;
+        std::string *out_ = nullptr;
+        std::unique_ptr<detail::http_body_writer> writer_;
+        std::deque<slot> pipeline_;
+        std::size_t queued_ = 0; // bytes and ids held by pipeline_
+        exchange current_;
+        bool in_request_ = false;
+        bool answered_ = false;
+        bool closing_ = false;
+    };
+
+    // HTTP/1.1 JSON-RPC server on the TCP reactors (io_uring or epoll)
+    using http_server = basic_tcp_server<http_codec>;
+
+    // Error for requests whose POST was answered with a status other than 2xx; data carries
+    // the status code
+    static const error http_status_error{-32002, "HTTP error", nullptr};
+
+    // Client side: an endpoint whose messages are POSTed over one kept-alive connection.
+    // Requests are pipelined: they are buffered as they are sent and written out together by
+    // the next wait() (or once enough has accumulated), and the responses are fed back to the
+    // endpoint as they arrive. A POST answered with a status other than 2xx fails the requests
+    // it carried with http_status_error. Not thread-safe: use from one thread.
+    class http_client
+    {
+      public:
+        static constexpr std::size_t read_buffer_size = 64 * 1024;
+        static constexpr std::size_t write_threshold = 64 * 1024;
+
+        http_client(const std::string &host, std::uint16_t port, std::string target = "/",
+                    endpoint_options options = {},
+                    std::size_t max_message_size = 64 * 1024 * 1024)
+            : parser_(false, max_message_size), buffer_(new char[read_buffer_size]), writer_(out_),
+              needs_poll_(options.batching || options.default_timeout.count() > 0),
+              ep_([this](const json &msg) { post(msg); }, options)
+        {
+            request_head_ = "POST " + target + " HTTP/1.1\r\nHost: " + host + ":" +
+                            std::to_string(port) + "\r\nContent-Type: application/json\r\n";
+            fd_ = detail::tcp_connect(host, port);
+        }
+
+        ~http_client() { ::close(fd_); }
+
+        http_client(const http_client &) = delete;
+        http_client &operator=(const http_client &) = delete;
+
+        endpoint &ep() { return ep_; }
+
+        // HTTP requests written or buffered that have not been answered yet
+        std::size_t outstanding() const { return outstanding_; }
+
+        // Send what is buffered, then wait up to `timeout` (negative: until something
+        // arrives) and dispatch the responses that came in. Returns how many arrived. Throws
+        // std::system_error if the connection fails or the server closes it.
+        std::size_t wait(std::chrono::milliseconds timeout = std::chrono::milliseconds(-1))
+        {
+            if (needs_poll_)
+            {
+                ep_.poll();
+                if (timeout.count() < 0 || timeout.count() > 1)
+                    timeout = std::chrono::milliseconds(1);
+            }
+            flush();
+            pollfd p{fd_, POLLIN, 0};
+            if (::poll(&p, 1, static_cast<int>(timeout.count())) <= 0)
+                return 0;
+            std::size_t answered = 0;
+            for (;;)
+            {
+                ssize_t n = ::recv(fd_, buffer_.get(), read_buffer_size, MSG_DONTWAIT);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    return answered;
+                if (n <= 0)
+                    throw std::system_error(n == 0 ? ECONNRESET : errno, std::generic_category(),
+                                            "http recv");
+                bool ok = parser_.feed(std::string_view(buffer_.get(), std::size_t(n)),
+                                       [&](const detail::http_head &head, std::string_view body)
+                                       {
+                                           ++answered;
+                                           --outstanding_;
+                                           answer(head.status, body);
+                                       });
+                if (!ok)
+                    throw std::system_error(EPROTO, std::generic_category(), "http response");
+                if (std::size_t(n) < read_buffer_size)
+                    return answered;
+            }
+        }
+
+        // wait() until every request has been answered
+        void wait_all()
+        {
+            while (outstanding_ > 0)
+                wait();
+        }
+
+      private:
+        void post(const json &msg)
+        {
+            out_ += request_head_;
+            writer_.write(msg);
+            ++outstanding_;
+            // Responses come back in POST order: remember which requests each one answers
+            std::uint32_t count = 0;
+            auto record = [&](const json &m)
+            {
+                auto id = m.find("id");
+                if (id != m.end() && !id->is_null() && m.contains("method"))
+                {
+                    posted_ids_.push_back(*id);
+                    ++count;
+                }
+            };
+            if (msg.is_array())
+                std::for_each(msg.begin(), msg.end(), record);
+            else
+                record(msg);
+            posted_.push_back(count);
+            if (out_.size() >= write_threshold)
+                flush();
+        }
+
+        // The response to the oldest outstanding POST. Anything but 2xx fails its requests,
+        // which would otherwise wait for a reply that never comes.
+        void answer(int status, std::string_view body)
+        {
+            std::uint32_t count = posted_.front();
+            posted_.pop_front();
+            if (status >= 200 && status < 300)
+            {
+                posted_ids_.erase(posted_ids_.begin(), posted_ids_.begin() + count);
+                if (!body.empty())
+                    ep_.receive_raw(body);
+                return;
+            }
+            error failed = http_status_error;
+            failed.data = json{{"status", status}};
+            // Popped one at a time: callbacks may post new requests behind them
+            for (std::uint32_t i = 0; i < count; ++i)
+            {
+                json id = std::move(posted_ids_.front());
+                posted_ids_.pop_front();
+                ep_.receive(make_error(std::move(id), failed));
+            }
+        }
+
+        void flush()
+        {
+            std::size_t offset = 0;
+            while (offset < out_.size())
+            {
+                ssize_t n = ::send(fd_, out_.data() + offset, out_.size() - offset, MSG_NOSIGNAL);
+                if (n >= 0)
+                    offset += static_cast<std::size_t>(n);
+                else if (errno != EINTR)
+                    throw std::system_error(errno, std::generic_category(), "http send");
+            }
+            out_.clear();
+        }
+
+        int fd_ = -1;
+        detail::http_parser parser_;
+        std::unique_ptr<char[]> buffer_;
+        std::string request_head_;
+        std::string out_;
+        detail::http_body_writer writer_;
+        std::size_t outstanding_ = 0;
+        std::deque<std::uint32_t> posted_; // requests with an id in each outstanding POST
+        std::deque<json> posted_ids_;      // their ids, in POST order
+        bool needs_poll_;
+        endpoint ep_;
+    };
+
+} // namespace pooriayousefi
@@ -0,0 +1,220 @@
+#pragma once
+
+#include "jsonrpc.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+// In-process transport: two endpoints in one binary exchange json objects by moving them, with
+// no serialization and no deep copies. Each direction is a lock-free single-producer/
+// single-consumer queue, so the two sides may run on different threads.
+
+namespace pooriayousefi
+{
+
+    namespace detail
+    {
+        // Bounded SPSC queue of json. push() is called only by the producer thread and pop()
+        // only by the consumer; the slots are moved into and out of, never copied.
+        class json_spsc_queue
+        {
+          public:
+            explicit json_spsc_queue(std::size_t capacity)
+                : capacity_(std::bit_ceil(std::max<std::size_t>(capacity, 2))),
+                  slots_(new json[capacity_])
+            {
+            }
+
+            bool push(json &&msg)
+            {
+                std::size_t tail = tail_.value.load(std::memory_order_relaxed);
+                if (tail - head_.value.load(std::memory_order_acquire) == capacity_)
+                    return false;
+                slots_[tail & (capacity_ - 1)] = std::move(msg);
+                tail_.value.store(tail + 1); // seq_cst: pairs with the consumer's sleep check
+                return true;
+            }
+
+            bool pop(json &out)
+            {
+                std::size_t head = head_.value.load(std::memory_order_relaxed);
+                if (head == tail_.value.load(std::memory_order_acquire))
+                    return false;
+                out = std::move(slots_[head & (capacity_ - 1)]);
+                head_.value.store(head + 1);
+                return true;
+            }
+
+            bool empty() const { return head_.value.load() == tail_.value.load(); }
+            bool full() const { return tail_.value.load() - head_.value.load() == capacity_; }
+
+          private:
+            struct alignas(64) cursor
+            {
+                std::atomic<std::size_t> value{0};
+            };
+
+            std::size_t capacity_;
+            std::unique_ptr<json[]> slots_;
+            cursor head_;
+            cursor tail_;
+        };
+    } // namespace detail
+
+    // A pair of connected endpoints, a() and b(). Single-threaded, call pump() to deliver
+    // messages; with a thread per side, each thread drives its own side with poll()/wait().
+    // When a queue is full, messages wait in the sender's backlog (flushed by its next poll)
+    // rather than blocking, so two busy sides cannot deadlock.
+    class inproc_channel
+    {
+      public:
+        class side
+        {
+          public:
+            endpoint &ep() { return ep_; }
+
+            // Deliver everything waiting for this side and push out its backlog. Never
+            // blocks; returns the number of messages delivered.
+            std::size_t poll()
+            {
+                if (needs_poll_)
+                    ep_.poll();
+                flush_backlog();
+                std::size_t delivered = 0;
+                json msg;
+                while (incoming_.pop(msg))
+                {
+                    peer_->wake_if_sleeping(); // the peer may be waiting for space
+                    ep_.receive(std::move(msg));
+                    ++delivered;
+                }
+                flush_backlog();
+                return delivered;
+            }
+
+            // poll(), first sleeping up to `timeout` (negative: indefinitely) if there is
+            // nothing to do yet. With timers enabled the sleep is capped at a millisecond.
+            std::size_t wait(std::chrono::nanoseconds timeout = std::chrono::nanoseconds(-1))
+            {
+                if (needs_poll_ && (timeout.count() < 0 || timeout > std::chrono::milliseconds(1)))
+                    timeout = std::chrono::milliseconds(1);
+                const auto deadline = std::chrono::steady_clock::now() + timeout;
+                std::unique_lock lock(mutex_);
+                while (!ready())
+                {
+                    // A waker clears the flag, so set it again on every round
+                    sleeping_.store(true);
+                    if (ready())
+                        break;
+                    if (timeout.count() < 0)
+                        wakeup_.wait(lock);
+                    else if (wakeup_.wait_until(lock, deadline) == std::cv_status::timeout)
+                        break;
+                }
+                sleeping_.store(false);
+                lock.unlock();
+                return poll();
+            }
+
+            // Messages waiting locally because the peer's queue was full
+            std::size_t backlog() const { return backlog_.size(); }
+
+          private:
+            friend class inproc_channel;
+
+            side(std::size_t capacity, const endpoint_options &options)
+                : incoming_(capacity),
+                  needs_poll_(options.batching || options.default_timeout.count() > 0),
+                  ep_([this](json &&msg) { send(std::move(msg)); }, options)
+            {
+            }
+
+            void send(json &&msg)
+            {
+                if (backlog_.empty() && peer_->incoming_.push(std::move(msg)))
+                {
+                    peer_->wake_if_sleeping();
+                    return;
+                }
+                backlog_.push_back(std::move(msg));
+            }
+
+            void flush_backlog()
+            {
+                bool sent = false;
+                while (!backlog_.empty() && peer_->incoming_.push(std::move(backlog_.front())))
+                {
+                    backlog_.pop_front();
+                    sent = true;
+                }
+                if (sent)
+                    peer_->wake_if_sleeping();
+            }
+
+            bool ready() const
+            {
+                return !incoming_.empty() || (!backlog_.empty() && !peer_->incoming_.full());
+            }
+
+            // The sleeping flag is only set under the mutex, so a waker that sees it and then
+            // takes the mutex cannot slip in between the sleeper's check and its wait
+            void wake_if_sleeping()
+            {
+                if (sleeping_.load() && sleeping_.exchange(false))
+                {
+                    std::lock_guard lock(mutex_);
+                    wakeup_.notify_one();
+                }
+            }
+
+            detail::json_spsc_queue incoming_;
+            side *peer_ = nullptr;
+            std::deque<json> backlog_;
+            std::atomic<bool> sleeping_{false};
+            std::mutex mutex_;
+            std::condition_variable wakeup_;
+            bool needs_poll_;
+            endpoint ep_;
+        };
+
+        explicit inproc_channel(endpoint_options a_options = {}, endpoint_options b_options = {},
+                                std::size_t capacity = 1024)
+            : a_(capacity, a_options), b_(capacity, b_options)
+        {
+            a_.peer_ = &b_;
+            b_.peer_ = &a_;
+        }
+
+        inproc_channel(const inproc_channel &) = delete;
+        inproc_channel &operator=(const inproc_channel &) = delete;
+
+        side &a() { return a_; }
+        side &b() { return b_; }
+
+        // Single-threaded use: deliver in both directions until both sides are idle. Returns
+        // the number of messages delivered.
+        std::size_t pump()
+        {
+            std::size_t total = 0;
+            for (;;)
+            {
+                std::size_t n = a_.poll() + b_.poll();
+                if (n == 0 && a_.backlog() == 0 && b_.backlog() == 0)
+                    return total;
+                total += n;
+            }
+        }
+
+      private:
+        side a_;
+        side b_;
+    };
+
+} // namespace pooriayousefi
@@ -0,0 +1,386 @@
+#pragma once
+
+#include "jsonrpc.hpp"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <new>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+// Shared-memory transport for processes on the same host (Linux). Two processes map one
+// POSIX shared memory object holding a single-producer/single-consumer ring per direction;
+// messages are copied in once by the sender and parsed in place by the receiver, and a side
+// only enters the kernel (futex) to sleep or to wake a sleeping peer.
+
+namespace pooriayousefi
+{
+
+    struct shm_options
+    {
+        std::string name;               // shm_open name, e.g. "/my-service"
+        bool create = false;            // one side creates (and later unlinks) the region
+        std::size_t capacity = 1 << 20; // bytes per direction, rounded up to a power of two
+        endpoint_options endpoint;
+    };
+
+    namespace detail
+    {
+        // Header at the start of the mapping; ring r is written by side r (0 = creator)
+        struct shm_layout
+        {
+            static constexpr std::uint32_t magic_value = 0x4a525348; // "JRSH"
+            static constexpr std::uint32_t wrap_marker = 0xffffffff;
+
+            struct alignas(64) cursor
+            {
+                std::atomic<std::uint64_t> value{0};
+            };
+
+            struct alignas(64) side
+            {
+                std::atomic<std::uint32_t> doorbell{0}; // futex word the side sleeps on
+                std::atomic<std::uint32_t> sleeping{0};
+                std::atomic<std::uint32_t> closed{0};
+            };
+
+            std::atomic<std::uint32_t> magic{0};
+            std::uint32_t version = 1;
+            std::uint64_t capacity = 0;
+            cursor head[2]; // consumer positions (bytes, monotonic)
+            cursor tail[2]; // producer positions
+            side sides[2];
+
+            static constexpr std::size_t data_offset()
+            {
+                return (sizeof(shm_layout) + 63) & ~std::size_t(63);
+            }
+        };
+
+        inline void futex_wait(std::atomic<std::uint32_t> &word, std::uint32_t expected,
+                               long long timeout_ns)
+        {
+            timespec ts{};
+            ts.tv_sec = static_cast<time_t>(timeout_ns / 1000000000);
+            ts.tv_nsec = static_cast<long>(timeout_ns % 1000000000);
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT, expected,
+                      timeout_ns < 0 ? nullptr : &ts, nullptr, 0);
+        }
+
+        inline void futex_wake(std::atomic<std::uint32_t> &word)
+        {
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE, 1, nullptr,
+                      nullptr, 0);
+        }
+    } // namespace detail
+
+    // One end of a shared-memory channel, with its endpoint. Records are a 4-byte length and
+    // the JSON text, 8-byte aligned; a record never wraps (a marker skips the ring's end), so
+    // the receiver always parses straight out of the mapping. When the outgoing ring is full,
+    // messages wait in a local backlog instead of blocking, so two busy peers cannot deadlock.
+    // Not thread-safe: use each transport (and its endpoint) from one thread.
+    class shm_transport
+    {
+      public:
+        explicit shm_transport(shm_options options)
+            : name_(std::move(options.name)), owner_(options.create),
+              self_(options.create ? 0 : 1),
+              needs_poll_(options.endpoint.batching ||
+                          options.endpoint.default_timeout.count() > 0),
+              ep_([this](const json &msg) { send(msg); }, options.endpoint)
+        {
+            ep_.set_response_sender([this](const response_parts &r) { send(r); });
+            if (owner_)
+                create(options.capacity);
+            else
+                open();
+        }
+
+        ~shm_transport()
+        {
+            close();
+            ::munmap(base_, size_);
+            if (owner_)
+                ::shm_unlink(name_.c_str());
+        }
+
+        shm_transport(const shm_transport &) = delete;
+        shm_transport &operator=(const shm_transport &) = delete;
+
+        endpoint &ep() { return ep_; }
+
+        // Dispatch every message already waiting and push out backlogged output. Never blocks;
+        // returns the number of messages received.
+        std::size_t poll()
+        {
+            if (needs_poll_)
+                ep_.poll();
+            flush_backlog();
+            std::size_t received = receive_all();
+            flush_backlog();
+            return received;
+        }
+
+        // poll(), first sleeping up to `timeout` (negative: indefinitely) if there is nothing
+        // to do yet
+        std::size_t wait(std::chrono::nanoseconds timeout = std::chrono::nanoseconds(-1))
+        {
+            if (!ready())
+            {
+                auto &me = layout_->sides[self_];
+                // The sequence is read before announcing: a peer that clears the flag bumps
+                // the doorbell after this, so the futex wait cannot miss that ring
+                std::uint32_t seq = me.doorbell.load();
+                me.sleeping.store(1);
+                if (!ready()) // re-check after announcing, or a wakeup could be missed
+                    detail::futex_wait(me.doorbell, seq, timeout.count());
+                me.sleeping.store(0);
+            }
+            return poll();
+        }
+
+        // Serve until the peer closes its end
+        void run()
+        {
+            const auto tick = needs_poll_ ? std::chrono::nanoseconds(std::chrono::milliseconds(1))
+                                          : std::chrono::nanoseconds(-1);
+            while (!peer_closed() || readable())
+                wait(tick);
+            poll();
+        }
+
+        // Tell the peer we are gone (its run() returns once it has drained our messages)
+        void close()
+        {
+            if (!layout_ || layout_->sides[self_].closed.exchange(1))
+                return;
+            ring_peer();
+        }
+
+        bool peer_closed() const { return layout_->sides[peer()].closed.load() != 0; }
+
+        // Messages waiting locally because the outgoing ring was full
+        std::size_t backlog() const { return backlog_.size(); }
+
+      private:
+        using layout = detail::shm_layout;
+
+        int peer() const { return 1 - self_; }
+
+        void create(std::size_t capacity)
+        {
+            capacity_ = std::bit_ceil(std::max<std::size_t>(capacity, 4096));
+            size_ = layout::data_offset() + 2 * capacity_;
+            int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+            if (fd < 0)
+                throw std::system_error(errno, std::generic_category(), "shm_open " + name_);
+            if (::ftruncate(fd, static_cast<off_t>(size_)) != 0)
+            {
+                int err = errno;
+                ::close(fd);
+                ::shm_unlink(name_.c_str());
+                throw std::system_error(err, std::generic_category(), "ftruncate");
+            }
+            map(fd);
+            layout_ = new (base_) layout();
+            layout_->capacity = capacity_;
+            layout_->magic.store(layout::magic_value, std::memory_order_release);
+            data_ = static_cast<char *>(base_) + layout::data_offset();
+        }
+
+        void open()
+        {
+            int fd = ::shm_open(name_.c_str(), O_RDWR | O_CLOEXEC, 0);
+            if (fd < 0)
+                throw std::system_error(errno, std::generic_category(), "shm_open " + name_);
+            struct stat st{};
+            ::fstat(fd, &st);
+            size_ = static_cast<std::size_t>(st.st_size);
+            if (size_ < layout::data_offset())
+            {
+                ::close(fd);
+                throw std::system_error(EINVAL, std::generic_category(), "shm region too small");
+            }
+            map(fd);
+            layout_ = static_cast<layout *>(base_);
+            capacity_ = layout_->capacity;
+            if (layout_->magic.load(std::memory_order_acquire) != layout::magic_value ||
+                layout_->version != 1 || layout::data_offset() + 2 * capacity_ != size_)
+            {
+                ::munmap(base_, size_);
+                throw std::system_error(EPROTO, std::generic_category(),
+                                        "not a jsonrpc shm region");
+            }
+            data_ = static_cast<char *>(base_) + layout::data_offset();
+            // Resume where a previous opener left off
+            read_pos_ = layout_->head[peer()].value.load();
+            write_pos_ = layout_->tail[self_].value.load();
+        }
+
+        void map(int fd)
+        {
+            base_ = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            int err = errno;
+            ::close(fd);
+            if (base_ == MAP_FAILED)
+                throw std::system_error(err, std::generic_category(), "mmap");
+        }
+
+        char *ring(int side) const { return data_ + std::size_t(side) * capacity_; }
+        std::size_t mask() const { return capacity_ - 1; }
+        static std::size_t record_size(std::size_t length) { return (4 + length + 7) & ~7ull; }
+
+        bool readable() const
+        {
+            return layout_->tail[peer()].value.load() != read_pos_;
+        }
+
+        bool writable() const
+        {
+            return !backlog_.empty() && fits(record_size(backlog_.front().size()));
+        }
+
+        bool ready() const { return readable() || writable() || peer_closed(); }
+
+        // Whether try_write() can make progress: write the record, or at least its wrap marker
+        bool fits(std::size_t need) const
+        {
+            std::size_t to_end = capacity_ - (write_pos_ & mask());
+            return free_space() >= std::min(need, to_end);
+        }
+
+        std::size_t free_space() const
+        {
+            std::uint64_t head = layout_->head[self_].value.load();
+            return capacity_ - static_cast<std::size_t>(write_pos_ - head);
+        }
+
+        // Serialized into a reused buffer, then copied into the ring (or the backlog)
+        template <typename M> void send(const M &msg)
+        {
+            text_.clear();
+            writer_.write(text_, msg);
+            if (record_size(text_.size()) > capacity_)
+                throw std::system_error(EMSGSIZE, std::generic_category(), "shm message");
+            if (backlog_.empty() && try_write(text_))
+                return;
+            backlog_.push_back(text_);
+        }
+
+        void flush_backlog()
+        {
+            while (!backlog_.empty() && try_write(backlog_.front()))
+                backlog_.pop_front();
+        }
+
+        bool try_write(std::string_view text)
+        {
+            const std::size_t need = record_size(text.size());
+            char *out = ring(self_);
+            std::size_t to_end = capacity_ - (write_pos_ & mask());
+            if (to_end < need)
+            {
+                // Skip the ring's end so the record stays contiguous. The marker is published
+                // on its own when only it fits, so a record that needs more than the space
+                // left at the end still goes out once the reader drains the ring.
+                if (free_space() < to_end)
+                    return false;
+                std::uint32_t marker = layout::wrap_marker;
+                std::memcpy(out + (write_pos_ & mask()), &marker, 4);
+                write_pos_ += to_end;
+                layout_->tail[self_].value.store(write_pos_);
+            }
+            if (free_space() < need)
+                return false;
+            auto length = static_cast<std::uint32_t>(text.size());
+            char *at = out + (write_pos_ & mask());
+            std::memcpy(at, &length, 4);
+            std::memcpy(at + 4, text.data(), text.size());
+            write_pos_ += need;
+            layout_->tail[self_].value.store(write_pos_);
+            ring_peer();
+            return true;
+        }
+
+        std::size_t receive_all()
+        {
+            const char *in = ring(peer());
+            std::uint64_t tail = layout_->tail[peer()].value.load(std::memory_order_acquire);
+            std::size_t count = 0;
+            while (read_pos_ != tail)
+            {
+                std::size_t offset = read_pos_ & mask();
+                std::uint32_t length;
+                std::memcpy(&length, in + offset, 4);
+                if (length == layout::wrap_marker)
+                {
+                    // Published like a record: a writer waiting for that space may be
+                    // blocked on it alone
+                    read_pos_ += capacity_ - offset;
+                    layout_->head[peer()].value.store(read_pos_);
+                    ring_peer();
+                    continue;
+                }
+                if (offset + record_size(length) > capacity_)
+                    throw std::system_error(EPROTO, std::generic_category(), "corrupt shm ring");
+                ep_.receive_raw(std::string_view(in + offset + 4, length));
+                read_pos_ += record_size(length);
+                // Hand the space back as we go so a blocked peer can continue
+                layout_->head[peer()].value.store(read_pos_);
+                ring_peer();
+                ++count;
+                if (count % 64 == 0)
+                    flush_backlog();
+                tail = layout_->tail[peer()].value.load(std::memory_order_acquire);
+            }
+            layout_->head[peer()].value.store(read_pos_);
+            return count;
+        }
+
+        // Wake the peer if it is asleep (it re-checks everything when woken). Cursor updates
+        // and the sleeping flag are all seq_cst, so either the peer sees our update before it
+        // sleeps or we see its flag here; clearing the flag keeps it to one wake per sleep.
+        void ring_peer()
+        {
+            auto &other = layout_->sides[peer()];
+            if (other.sleeping.load() && other.sleeping.exchange(0))
+            {
+                other.doorbell.fetch_add(1);
+                detail::futex_wake(other.doorbell);
+            }
+        }
+
+        std::string name_;
+        bool owner_;
+        int self_;
+        bool needs_poll_;
+        void *base_ = nullptr;
+        std::size_t size_ = 0;
+        layout *layout_ = nullptr;
+        char *data_ = nullptr;
+        std::size_t capacity_ = 0;
+        std::uint64_t read_pos_ = 0;
+        std::uint64_t write_pos_ = 0;
+        std::deque<std::string> backlog_;
+        message_writer writer_;
+        std::string text_; // outgoing message, kept for its capacity
+        endpoint ep_;
+    };
+
+} // namespace pooriayousefi
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "jsonrpc.hpp"
+#include "jsonrpc_framing.hpp"
+
+#include <poll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+// Content-Length framed transport over a pair of file descriptors: stdin/stdout by default
+// (language-server style), or any pipes.
+
+namespace pooriayousefi
+{
+
+    class stdio_transport
+    {
+      public:
+        static constexpr std::size_t read_buffer_size = 64 * 1024;
+
+        explicit stdio_transport(endpoint_options options = {}, int in_fd = STDIN_FILENO,
+                                 int out_fd = STDOUT_FILENO,
+                                 std::size_t max_message_size = 64 * 1024 * 1024)
+            : in_(in_fd), out_(out_fd), codec_(max_message_size),
+              buffer_(new char[read_buffer_size]),
+              needs_poll_(options.batching || options.default_timeout.count() > 0),
+              ep_([this](const json &msg) { write_message(msg); }, options)
+        {
+            ep_.set_response_sender([this](const response_parts &r) { write_message(r); });
+        }
+
+        stdio_transport(const stdio_transport &) = delete;
+        stdio_transport &operator=(const stdio_transport &) = delete;
+
+        // Register handlers and send requests through this
+        endpoint &ep() { return ep_; }
+
+        // Read and dispatch messages until end of input (true) or a framing error (false).
+        // Throws std::system_error if reading or writing fails.
+        bool run()
+        {
+            auto dispatch = [this](std::string_view msg) { ep_.receive_raw(msg); };
+            for (;;)
+            {
+                if (needs_poll_ && !wait_readable())
+                    continue;
+                // The rest of a large body is read straight into the codec's body buffer
+                auto [body, room] = codec_.body_space();
+                if (room >= read_buffer_size)
+                {
+                    std::size_t n = read_some(body, room);
+                    if (n == 0)
+                        return false; // truncated message
+                    codec_.body_written(n, dispatch);
+                    continue;
+                }
+                std::size_t n = read_some(buffer_.get(), read_buffer_size);
+                if (n == 0)
+                    return codec_.idle();
+                if (!codec_.decode(std::string_view(buffer_.get(), n), dispatch))
+                    return false;
+            }
+        }
+
+      private:
+        std::size_t read_some(char *dst, std::size_t size)
+        {
+            for (;;)
+            {
+                ssize_t n = ::read(in_, dst, size);
+                if (n >= 0)
+                    return static_cast<std::size_t>(n);
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    wait_for(in_, POLLIN, -1);
+                else if (errno != EINTR)
+                    throw std::system_error(errno, std::generic_category(), "read");
+            }
+        }
+
+        // With timers to run, wake at least every millisecond for endpoint::poll
+        bool wait_readable()
+        {
+            bool ready = wait_for(in_, POLLIN, 1);
+            ep_.poll();
+            return ready;
+        }
+
+        static bool wait_for(int fd, short events, int timeout_ms)
+        {
+            pollfd p{fd, events, 0};
+            return ::poll(&p, 1, timeout_ms) > 0;
+        }
+
+        // Header and body go out in one writev (more only if the pipe takes it partially).
+        // The body is serialized into a buffer that is reused from message to message.
+        template <typename M> void write_message(const M &msg)
+        {
+            body_.clear();
+            writer_.write(body_, msg);
+            char header[content_length_codec::header_capacity];
+            iovec iov[2] = {
+                {header, content_length_codec::format_header(body_.size(), header)},
+                {body_.data(), body_.size()}};
+            iovec *next = iov;
+            int count = 2;
+            while (count > 0)
+            {
+                ssize_t n = ::writev(out_, next, count);
+                if (n < 0)
+                {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                        wait_for(out_, POLLOUT, -1);
+                    else if (errno != EINTR)
+                        throw std::system_error(errno, std::generic_category(), "writev");
+                    continue;
+                }
+                auto written = static_cast<std::size_t>(n);
+                while (count > 0 && written >= next->iov_len)
+                {
+                    written -= next->iov_len;
+                    ++next;
+                    --count;
+                }
+                if (count > 0)
+                {
+                    next->iov_base = static_cast<char *>(next->iov_base) + written;
+                    next->iov_len -= written;
+                }
+            }
+        }
+
+        int in_;
+        int out_;
+        content_length_codec codec_;
+        std::unique_ptr<char[]> buffer_;
+        message_writer writer_;
+        std::string body_; // outgoing body, kept for its capacity
+        bool needs_poll_;
+        endpoint ep_;
+    };
+
+} // namespace pooriayousefi
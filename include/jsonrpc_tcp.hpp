@@ -0,0 +1,836 @@
+#pragma once
+
+#include "jsonrpc.hpp"
+#include "jsonrpc_framing.hpp"
+#include "jsonrpc_uring.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// TCP server transport (Linux: io_uring or epoll)
+
+namespace pooriayousefi
+{
+
+    // Event loop behind tcp_server. automatic picks io_uring when the kernel offers what the
+    // reactor needs (Linux 6.0+, not disabled) and falls back to epoll otherwise.
+    enum class tcp_backend
+    {
+        automatic,
+        epoll,
+        io_uring
+    };
+
+    struct tcp_server_options
+    {
+        std::string host = "127.0.0.1";
+        std::uint16_t port = 0; // 0: pick a free port (see port())
+        // Reactor threads. Each has its own SO_REUSEPORT listening socket and event loop, so
+        // the kernel spreads connections across them and a connection never changes thread.
+        std::size_t reactors = 1;
+        int backlog = 1024;
+        tcp_backend backend = tcp_backend::automatic; // io_uring only: throws if unsupported
+        // A connection is not read while this much of its output is unsent (counting what
+        // the codec holds back), so a peer that pipelines requests but never reads, or that
+        // pipelines behind a slow request, cannot make the server buffer without bound
+        std::size_t max_pending_output = 4 * 1024 * 1024;
+        endpoint_options endpoint;
+    };
+
+    namespace detail
+    {
+        [[noreturn]] inline void throw_errno(const char *what)
+        {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+
+        // Owning file descriptor
+        class unique_fd
+        {
+          public:
+            unique_fd() = default;
+            explicit unique_fd(int fd) : fd_(fd) {}
+            unique_fd(unique_fd &&other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+            unique_fd &operator=(unique_fd &&other) noexcept
+            {
+                if (this != &other)
+                {
+                    reset();
+                    fd_ = std::exchange(other.fd_, -1);
+                }
+                return *this;
+            }
+            unique_fd(const unique_fd &) = delete;
+            unique_fd &operator=(const unique_fd &) = delete;
+            ~unique_fd() { reset(); }
+
+            int get() const { return fd_; }
+            explicit operator bool() const { return fd_ >= 0; }
+            void reset()
+            {
+                if (fd_ >= 0)
+                    ::close(fd_);
+                fd_ = -1;
+            }
+
+          private:
+            int fd_ = -1;
+        };
+
+        inline unique_fd listen_socket(const std::string &host, std::uint16_t port, int backlog)
+        {
+            unique_fd fd(::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+            if (!fd)
+                throw_errno("socket");
+            int one = 1;
+            ::setsockopt(fd.get(), SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (::setsockopt(fd.get(), SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0)
+                throw_errno("setsockopt(SO_REUSEPORT)");
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+                throw std::invalid_argument("invalid IPv4 address: " + host);
+            if (::bind(fd.get(), reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+                throw_errno("bind");
+            if (::listen(fd.get(), backlog) != 0)
+                throw_errno("listen");
+            return fd;
+        }
+
+        inline std::uint16_t local_port(int fd)
+        {
+            sockaddr_in addr{};
+            socklen_t len = sizeof(addr);
+            if (::getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) != 0)
+                throw_errno("getsockname");
+            return ntohs(addr.sin_port);
+        }
+
+        // Write as much of out[offset..] as the socket takes. Returns false on a hard error.
+        inline bool flush_socket(int fd, std::string &out, std::size_t &offset)
+        {
+            while (offset < out.size())
+            {
+                ssize_t n = ::send(fd, out.data() + offset, out.size() - offset, MSG_NOSIGNAL);
+                if (n > 0)
+                {
+                    offset += static_cast<std::size_t>(n);
+                    continue;
+                }
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    break;
+                return false;
+            }
+            if (offset == out.size())
+            {
+                out.clear();
+                offset = 0;
+            }
+            else if (offset > out.size() / 2)
+            {
+                out.erase(0, offset);
+                offset = 0;
+            }
+            return true;
+        }
+    } // namespace detail
+
+    // Non-blocking TCP server. Every accepted connection gets its own endpoint, set up by
+    // `setup` (register handlers there); messages are framed by Codec (ndjson_codec by
+    // default). Reactors run on io_uring when the kernel supports it, otherwise on
+    // edge-triggered epoll (see tcp_backend). Handlers run on the connection's reactor thread;
+    // async handlers must be resumed on that thread too.
+    template <typename Codec = ndjson_codec> class basic_tcp_server
+    {
+      public:
+        using setup_fn = std::function<void(endpoint &)>;
+
+        basic_tcp_server(tcp_server_options options, setup_fn setup)
+            : options_(std::move(options)), setup_(std::move(setup))
+        {
+            backend_ = options_.backend;
+            if (backend_ != tcp_backend::epoll)
+            {
+                bool supported = uring_supported();
+                if (!supported && backend_ == tcp_backend::io_uring)
+                    throw std::system_error(ENOSYS, std::generic_category(), "io_uring");
+                backend_ = supported ? tcp_backend::io_uring : tcp_backend::epoll;
+            }
+
+            const std::size_t count = std::max<std::size_t>(options_.reactors, 1);
+            // The first socket picks the port when 0 was asked for; the rest share it
+            auto first = detail::listen_socket(options_.host, options_.port, options_.backlog);
+            port_ = detail::local_port(first.get());
+            reactors_.reserve(count);
+            reactors_.push_back(make_reactor(std::move(first)));
+            for (std::size_t i = 1; i < count; ++i)
+            {
+                reactors_.push_back(
+                    make_reactor(detail::listen_socket(options_.host, port_, options_.backlog)));
+            }
+        }
+
+        ~basic_tcp_server() { stop(); }
+
+        basic_tcp_server(const basic_tcp_server &) = delete;
+        basic_tcp_server &operator=(const basic_tcp_server &) = delete;
+
+        std::uint16_t port() const { return port_; }
+
+        // Backend actually in use (never automatic)
+        tcp_backend backend() const { return backend_; }
+
+        // Run the reactors on background threads
+        void start()
+        {
+            for (auto &r : reactors_)
+                r->thread = std::thread([&r] { r->run(); });
+        }
+
+        // Stop the reactors, close every connection and wait for the threads
+        void stop()
+        {
+            for (auto &r : reactors_)
+                r->wake();
+            for (auto &r : reactors_)
+            {
+                if (r->thread.joinable())
+                    r->thread.join();
+            }
+        }
+
+        // Connections currently open (approximate while running)
+        std::size_t connection_count() const
+        {
+            std::size_t n = 0;
+            for (const auto &r : reactors_)
+                n += r->open.load(std::memory_order_relaxed);
+            return n;
+        }
+
+      private:
+        struct connection
+        {
+            connection(basic_tcp_server &server, detail::unique_fd socket)
+                : fd(std::move(socket)),
+                  ep([this](const json &msg) { codec.encode(msg, out); }, server.options_.endpoint)
+            {
+                // Codecs that write replies of their own (http_codec) get the output buffer
+                if constexpr (requires { codec.attach(out); })
+                    codec.attach(out);
+                // Responses are serialized straight into `out`, never built as json
+                if constexpr (requires(const response_parts &r) { codec.encode(r, out); })
+                    ep.set_response_sender([this](const response_parts &r)
+                                           { codec.encode(r, out); });
+                server.setup_(ep);
+            }
+
+            // The codec is done with the connection (see http_codec::finished)
+            bool finished() const
+            {
+                if constexpr (requires { codec.finished(); })
+                    return codec.finished();
+                else
+                    return false;
+            }
+
+            // Output the codec holds back (http_codec: responses queued behind one still owed)
+            std::size_t held_output() const
+            {
+                if constexpr (requires { codec.pending_output(); })
+                    return codec.pending_output();
+                else
+                    return 0;
+            }
+
+            detail::unique_fd fd;
+            Codec codec;
+            std::string out;
+            std::size_t out_offset = 0;
+            bool draining = false; // no more input: close once the output has been written
+            bool paused = false;   // not read until its output drains
+            endpoint ep;
+        };
+
+        // What both backends share: the listening socket, a wakeup eventfd for stop() and
+        // the thread
+        struct reactor
+        {
+            reactor(basic_tcp_server &s, detail::unique_fd listener)
+                : server(s), listen_fd(std::move(listener)),
+                  wake_fd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+            {
+                if (!wake_fd)
+                    detail::throw_errno("eventfd");
+            }
+            virtual ~reactor() = default;
+
+            virtual void run() = 0;
+
+            void wake()
+            {
+                stopping.store(true, std::memory_order_relaxed);
+                std::uint64_t one = 1;
+                [[maybe_unused]] auto n = ::write(wake_fd.get(), &one, sizeof(one));
+            }
+
+            // Endpoints need poll() when they have timers: request timeouts or batching
+            bool needs_poll() const
+            {
+                const auto &eo = server.options_.endpoint;
+                return eo.batching || eo.default_timeout.count() > 0;
+            }
+
+            template <typename Conn> std::unique_ptr<Conn> make_connection(int fd)
+            {
+                int one = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                auto conn = std::make_unique<Conn>(server, detail::unique_fd(fd));
+                open.fetch_add(1, std::memory_order_relaxed);
+                return conn;
+            }
+
+            basic_tcp_server &server;
+            detail::unique_fd listen_fd;
+            detail::unique_fd wake_fd;
+            std::atomic<bool> stopping{false};
+            std::atomic<std::size_t> open{0};
+            std::thread thread;
+        };
+
+        // Edge-triggered epoll: read to EAGAIN, dispatch, write what the socket takes
+        struct epoll_reactor final : reactor
+        {
+            epoll_reactor(basic_tcp_server &s, detail::unique_fd listener)
+                : reactor(s, std::move(listener)), epoll_fd(::epoll_create1(EPOLL_CLOEXEC))
+            {
+                if (!epoll_fd)
+                    detail::throw_errno("epoll_create1");
+                add(this->listen_fd.get(), &this->listen_fd, EPOLLIN | EPOLLET);
+                add(this->wake_fd.get(), &this->wake_fd, EPOLLIN);
+            }
+
+            void add(int fd, void *tag, std::uint32_t events)
+            {
+                epoll_event ev{};
+                ev.events = events;
+                ev.data.ptr = tag;
+                if (::epoll_ctl(epoll_fd.get(), EPOLL_CTL_ADD, fd, &ev) != 0)
+                    detail::throw_errno("epoll_ctl");
+            }
+
+            void run() override
+            {
+                const bool poll_endpoints = this->needs_poll();
+                std::vector<epoll_event> events(256);
+                while (!this->stopping.load(std::memory_order_relaxed))
+                {
+                    int n = ::epoll_wait(epoll_fd.get(), events.data(),
+                                         static_cast<int>(events.size()), poll_endpoints ? 1 : -1);
+                    if (n < 0 && errno != EINTR)
+                        break;
+                    for (int i = 0; i < n; ++i)
+                    {
+                        void *tag = events[i].data.ptr;
+                        if (tag == &this->listen_fd)
+                            accept_all();
+                        else if (tag != &this->wake_fd)
+                            service(static_cast<connection *>(tag), events[i].events);
+                    }
+                    if (poll_endpoints)
+                        poll_all();
+                }
+                connections.clear();
+                this->open.store(0, std::memory_order_relaxed);
+            }
+
+            void accept_all()
+            {
+                for (;;)
+                {
+                    int fd = ::accept4(this->listen_fd.get(), nullptr, nullptr,
+                                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (fd < 0)
+                    {
+                        if (errno == EINTR || errno == ECONNABORTED)
+                            continue;
+                        return; // EAGAIN, or out of descriptors: retried on the next event
+                    }
+                    auto conn = this->template make_connection<connection>(fd);
+                    add(fd, conn.get(), EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+                    connections.emplace(conn.get(), std::move(conn));
+                }
+            }
+
+            void service(connection *c, std::uint32_t ev)
+            {
+                bool alive = !(ev & EPOLLERR);
+                // A paused connection resumes once the socket has taken some of its output
+                if (alive && c->paused && (ev & EPOLLOUT))
+                    alive = detail::flush_socket(c->fd.get(), c->out, c->out_offset);
+                if (alive && !c->draining &&
+                    ((ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) || c->paused))
+                    alive = read_all(*c);
+                if (alive || !c->out.empty())
+                    alive = detail::flush_socket(c->fd.get(), c->out, c->out_offset) && alive;
+                if (!alive || done(*c))
+                    close(c);
+            }
+
+            // A draining connection is closed once its output has gone out
+            static bool done(connection &c)
+            {
+                if (c.finished())
+                    c.draining = true;
+                return c.draining && c.out.empty();
+            }
+
+            // Drain the socket (edge-triggered) and dispatch every complete message. Returns
+            // false once the peer is gone; a stream the codec rejects starts draining.
+            bool read_all(connection &c)
+            {
+                for (;;)
+                {
+                    // Backpressure: leave the input in the socket until the peer reads. The
+                    // output is only left over when the socket is full, so EPOLLOUT follows.
+                    const std::size_t limit = this->server.options_.max_pending_output;
+                    c.paused = c.out.size() - c.out_offset + c.held_output() >= limit;
+                    if (c.paused)
+                        return true;
+                    ssize_t n = ::recv(c.fd.get(), buffer, sizeof(buffer), 0);
+                    if (n > 0)
+                    {
+                        bool ok = c.codec.decode(std::string_view(buffer, std::size_t(n)),
+                                                 [&c](std::string_view m) { c.ep.receive_raw(m); });
+                        // Flush per chunk so a pipelining peer doesn't pile up responses
+                        if (!detail::flush_socket(c.fd.get(), c.out, c.out_offset))
+                            return false;
+                        if (!ok)
+                        {
+                            // Its final reply (an error, a close frame) is still written
+                            c.draining = true;
+                            return true;
+                        }
+                        continue;
+                    }
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        return true;
+                    return false; // EOF or error
+                }
+            }
+
+            void poll_all()
+            {
+                auto now = endpoint::clock::now();
+                std::vector<connection *> finished;
+                for (auto &[ptr, conn] : connections)
+                {
+                    conn->ep.poll(now);
+                    bool alive = conn->out.empty() ||
+                                 detail::flush_socket(conn->fd.get(), conn->out, conn->out_offset);
+                    // Held output released by a timer or another connection resumes reading
+                    if (alive && conn->paused && !conn->draining)
+                        alive = read_all(*conn);
+                    if (!alive || done(*conn))
+                        finished.push_back(conn.get());
+                }
+                for (auto *c : finished)
+                    close(c);
+            }
+
+            void close(connection *c)
+            {
+                ::epoll_ctl(epoll_fd.get(), EPOLL_CTL_DEL, c->fd.get(), nullptr);
+                connections.erase(c);
+                this->open.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            detail::unique_fd epoll_fd;
+            std::unordered_map<connection *, std::unique_ptr<connection>> connections;
+            char buffer[64 * 1024];
+        };
+
+        // io_uring: one multishot accept, one multishot recv per connection into kernel-picked
+        // provided buffers, and sends queued while a batch of completions is processed. Each
+        // loop iteration is a single io_uring_enter that submits the batch and waits for more.
+        // A connection whose output backs up has its recv cancelled until the sends catch up.
+        struct uring_reactor final : reactor
+        {
+            static constexpr unsigned buffer_count = 256; // power of two
+            static constexpr unsigned buffer_size = 16 * 1024;
+
+            // user_data: connection pointer (or null) tagged with the operation in the low bits
+            enum op : std::uint64_t
+            {
+                op_accept,
+                op_wake,
+                op_recv,
+                op_send,
+                op_cancel
+            };
+
+            struct uring_connection : connection
+            {
+                using connection::connection;
+
+                std::string sending; // buffer owned by the kernel while a send is in flight
+                std::size_t sent = 0;
+                std::string held; // received while paused, decoded on resume
+                unsigned inflight = 0; // operations whose completions are still to come
+                bool recv_armed = false;
+                bool recv_cancelled = false; // the armed recv has been asked to stop
+                bool send_active = false;
+                bool queued = false;
+                bool closing = false;
+            };
+
+            uring_reactor(basic_tcp_server &s, detail::unique_fd listener)
+                : reactor(s, std::move(listener)), ring(256, 4096),
+                  buffers(ring, 0, buffer_count, buffer_size)
+            {
+            }
+
+            // The ring goes first so the kernel is done with buffers before they are freed
+            ~uring_reactor() override { ring.close(); }
+
+            static std::uint64_t tag(void *p, op o)
+            {
+                return static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(p)) | o;
+            }
+
+            void run() override
+            {
+                const long long timeout = this->needs_poll() ? 1000000 : -1; // 1 ms
+                arm_accept();
+                arm_wake();
+                while (!this->stopping.load(std::memory_order_relaxed))
+                {
+                    ring.submit_and_wait(timeout);
+                    ring.for_each_completion([this](const io_uring_cqe &cqe) { complete(cqe); });
+                    if (timeout >= 0)
+                    {
+                        auto now = endpoint::clock::now();
+                        for (auto &[ptr, conn] : connections)
+                        {
+                            conn->ep.poll(now);
+                            if (conn->finished() && !conn->draining)
+                                drain(conn.get());
+                            else if (conn->paused && !conn->closing && !backed_up(conn.get()))
+                                resume(conn.get());
+                            queue(conn.get());
+                        }
+                    }
+                    for (auto *c : queued)
+                    {
+                        c->queued = false;
+                        if (!c->closing)
+                            start_send(c);
+                    }
+                    queued.clear();
+                    std::erase_if(dead,
+                                  [this](uring_connection *c)
+                                  {
+                                      if (c->inflight != 0)
+                                          return false;
+                                      connections.erase(c);
+                                      return true;
+                                  });
+                }
+                ring.close();
+                dead.clear();
+                connections.clear();
+                this->open.store(0, std::memory_order_relaxed);
+            }
+
+            void complete(const io_uring_cqe &cqe)
+            {
+                auto *c = reinterpret_cast<uring_connection *>(
+                    static_cast<std::uintptr_t>(cqe.user_data & ~std::uint64_t(7)));
+                switch (static_cast<op>(cqe.user_data & 7))
+                {
+                case op_accept:
+                    if (cqe.res >= 0)
+                        accepted(cqe.res);
+                    if (!(cqe.flags & IORING_CQE_F_MORE))
+                        arm_accept();
+                    break;
+                case op_wake:
+                    arm_wake();
+                    break;
+                case op_recv:
+                    received(c, cqe);
+                    break;
+                case op_send:
+                    sent(c, cqe.res);
+                    break;
+                case op_cancel:
+                    break;
+                }
+            }
+
+            void arm_accept()
+            {
+                io_uring_sqe *sqe = ring.get_sqe();
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->fd = this->listen_fd.get();
+                sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+                sqe->accept_flags = SOCK_CLOEXEC;
+                sqe->user_data = tag(nullptr, op_accept);
+            }
+
+            void arm_wake()
+            {
+                io_uring_sqe *sqe = ring.get_sqe();
+                sqe->opcode = IORING_OP_POLL_ADD;
+                sqe->fd = this->wake_fd.get();
+                sqe->poll32_events = POLLIN;
+                sqe->user_data = tag(nullptr, op_wake);
+            }
+
+            void arm_recv(uring_connection *c)
+            {
+                io_uring_sqe *sqe = ring.get_sqe();
+                sqe->opcode = IORING_OP_RECV;
+                sqe->fd = c->fd.get();
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = buffers.group();
+                sqe->user_data = tag(c, op_recv);
+                c->recv_armed = true;
+                c->recv_cancelled = false;
+                ++c->inflight;
+            }
+
+            // Ask the kernel to end the multishot recv; its last completion has no F_MORE
+            void cancel_recv(uring_connection *c)
+            {
+                if (!c->recv_armed || c->recv_cancelled)
+                    return;
+                io_uring_sqe *sqe = ring.get_sqe();
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = -1;
+                sqe->addr = tag(c, op_recv);
+                sqe->user_data = tag(nullptr, op_cancel);
+                c->recv_cancelled = true;
+            }
+
+            // Backpressure: output not yet written, whether queued, in a send or held back by
+            // the codec
+            bool backed_up(const uring_connection *c) const
+            {
+                return c->out.size() + c->sending.size() - c->sent + c->held_output() >=
+                       this->server.options_.max_pending_output;
+            }
+
+            // Stop receiving until the output has drained below the limit (see sent)
+            void pause(uring_connection *c)
+            {
+                c->paused = true;
+                cancel_recv(c);
+            }
+
+            void resume(uring_connection *c)
+            {
+                c->paused = false;
+                if (!c->held.empty() && !c->draining)
+                {
+                    std::string held = std::exchange(c->held, {});
+                    dispatch(c, held);
+                    if (c->closing)
+                        return;
+                    if (backed_up(c))
+                    {
+                        pause(c);
+                        return;
+                    }
+                }
+                if (!c->recv_armed)
+                    arm_recv(c);
+            }
+
+            void dispatch(uring_connection *c, std::string_view data)
+            {
+                if (!c->codec.decode(data, [c](std::string_view m) { c->ep.receive_raw(m); }))
+                    drain(c);
+                queue(c);
+            }
+
+            void accepted(int fd)
+            {
+                auto conn = this->template make_connection<uring_connection>(fd);
+                arm_recv(conn.get());
+                connections.emplace(conn.get(), std::move(conn));
+            }
+
+            void received(uring_connection *c, const io_uring_cqe &cqe)
+            {
+                if (!(cqe.flags & IORING_CQE_F_MORE))
+                {
+                    c->recv_armed = false;
+                    --c->inflight;
+                }
+                if (cqe.flags & IORING_CQE_F_BUFFER)
+                {
+                    auto id = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                    // Completions still arrive between pause() and the cancel taking effect
+                    if (cqe.res > 0 && !c->closing && !c->draining)
+                    {
+                        std::string_view data(buffers.data(id), std::size_t(cqe.res));
+                        if (c->paused)
+                            c->held.append(data);
+                        else
+                            dispatch(c, data);
+                    }
+                    buffers.recycle(id);
+                }
+                if (c->closing)
+                    return;
+                // 0: peer closed; ENOBUFS: ran out of buffers, which are recycled by now;
+                // ECANCELED: stopped by pause()
+                if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED))
+                    close(c);
+                else if (c->paused || backed_up(c))
+                    pause(c);
+                else if (!c->recv_armed)
+                    arm_recv(c);
+            }
+
+            void queue(uring_connection *c)
+            {
+                if (!c->queued && !c->closing && !c->out.empty())
+                {
+                    c->queued = true;
+                    queued.push_back(c);
+                }
+            }
+
+            void start_send(uring_connection *c)
+            {
+                if (c->send_active)
+                    return;
+                if (c->sending.empty())
+                {
+                    if (c->out.empty())
+                        return;
+                    std::swap(c->sending, c->out);
+                    c->sent = 0;
+                }
+                io_uring_sqe *sqe = ring.get_sqe();
+                sqe->opcode = IORING_OP_SEND;
+                sqe->fd = c->fd.get();
+                sqe->addr = reinterpret_cast<std::uint64_t>(c->sending.data() + c->sent);
+                sqe->len = static_cast<std::uint32_t>(c->sending.size() - c->sent);
+                sqe->msg_flags = MSG_NOSIGNAL;
+                sqe->user_data = tag(c, op_send);
+                c->send_active = true;
+                ++c->inflight;
+            }
+
+            void sent(uring_connection *c, int res)
+            {
+                c->send_active = false;
+                --c->inflight;
+                if (c->closing)
+                    return;
+                if (res < 0)
+                {
+                    close(c);
+                    return;
+                }
+                c->sent += static_cast<std::size_t>(res);
+                if (c->sent == c->sending.size())
+                {
+                    c->sending.clear();
+                    c->sent = 0;
+                }
+                start_send(c);
+                if (c->draining && !c->send_active)
+                    close(c);
+                else if (c->paused && !backed_up(c))
+                    resume(c);
+            }
+
+            // Let the codec's last words (an error reply, a close frame) go out, then close
+            void drain(uring_connection *c)
+            {
+                c->draining = true;
+                if (c->out.empty() && c->sending.empty())
+                    close(c);
+            }
+
+            // Connections are freed once their last completion has arrived
+            void close(uring_connection *c)
+            {
+                if (c->closing)
+                    return;
+                c->closing = true;
+                cancel_recv(c);
+                ::shutdown(c->fd.get(), SHUT_RDWR);
+                dead.push_back(c);
+                this->open.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            detail::uring ring;
+            detail::uring_buffer_ring buffers;
+            std::unordered_map<connection *, std::unique_ptr<uring_connection>> connections;
+            std::vector<uring_connection *> queued;
+            std::vector<uring_connection *> dead;
+        };
+
+        static bool uring_supported()
+        {
+            try
+            {
+                detail::uring ring(4, 8);
+                detail::uring_buffer_ring probe(ring, 0, 1, 64);
+                return true;
+            }
+            catch (const std::system_error &)
+            {
+                return false;
+            }
+        }
+
+        std::unique_ptr<reactor> make_reactor(detail::unique_fd listener)
+        {
+            if (backend_ == tcp_backend::io_uring)
+                return std::make_unique<uring_reactor>(*this, std::move(listener));
+            return std::make_unique<epoll_reactor>(*this, std::move(listener));
+        }
+
+        tcp_server_options options_;
+        setup_fn setup_;
+        tcp_backend backend_ = tcp_backend::epoll;
+        std::uint16_t port_ = 0;
+        std::vector<std::unique_ptr<reactor>> reactors_;
+    };
+
+    using tcp_server = basic_tcp_server<>;
+
+} // namespace pooriayousefi
@@ -0,0 +1,510 @@
+#pragma once
+
+#include "jsonrpc.hpp"
+#include "jsonrpc_framing.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Unix domain socket transport (Linux) for same-host peers. Messages are NDJSON; in addition,
+// file descriptors can travel alongside them (SCM_RIGHTS), so a large payload can be handed
+// over as a sealed memfd referenced from the JSON instead of being serialized inline.
+//
+// On the wire a descriptor reference is the object {"$fd": <n>, "size": <bytes>}, where n is
+// the descriptor's position among those sent with that message. Receivers see n replaced by
+// their local descriptor number and claim it with take_fd() (or map it with mapped_blob).
+
+namespace pooriayousefi
+{
+
+    namespace detail
+    {
+        [[noreturn]] inline void throw_unix_errno(const char *what)
+        {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+
+        inline sockaddr_un unix_address(const std::string &path)
+        {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path))
+                throw std::system_error(ENAMETOOLONG, std::generic_category(), "unix socket path");
+            std::memcpy(addr.sun_path, path.data(), path.size());
+            return addr;
+        }
+    } // namespace detail
+
+    // Read-only mapping of a received blob descriptor
+    class mapped_blob
+    {
+      public:
+        explicit mapped_blob(int fd)
+        {
+            struct stat st{};
+            if (::fstat(fd, &st) != 0)
+                detail::throw_unix_errno("fstat");
+            size_ = static_cast<std::size_t>(st.st_size);
+            if (size_ == 0)
+                return;
+            void *p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED)
+                detail::throw_unix_errno("mmap");
+            data_ = static_cast<const char *>(p);
+        }
+
+        ~mapped_blob()
+        {
+            if (data_)
+                ::munmap(const_cast<char *>(data_), size_);
+        }
+
+        mapped_blob(const mapped_blob &) = delete;
+        mapped_blob &operator=(const mapped_blob &) = delete;
+
+        const char *data() const { return data_; }
+        std::size_t size() const { return size_; }
+        std::string_view view() const { return {data_, size_}; }
+
+      private:
+        const char *data_ = nullptr;
+        std::size_t size_ = 0;
+    };
+
+    // Listening socket bound to a filesystem path (removed again on destruction)
+    class unix_listener
+    {
+      public:
+        explicit unix_listener(std::string path, int backlog = 64) : path_(std::move(path))
+        {
+            fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd_ < 0)
+                detail::throw_unix_errno("socket");
+            sockaddr_un addr = detail::unix_address(path_);
+            ::unlink(path_.c_str()); // stale socket from an earlier run
+            if (::bind(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+                ::listen(fd_, backlog) != 0)
+            {
+                int err = errno;
+                ::close(fd_);
+                throw std::system_error(err, std::generic_category(), "bind " + path_);
+            }
+        }
+
+        ~unix_listener()
+        {
+            ::close(fd_);
+            ::unlink(path_.c_str());
+        }
+
+        unix_listener(const unix_listener &) = delete;
+        unix_listener &operator=(const unix_listener &) = delete;
+
+        // Block until a client connects; returns the connected socket
+        int accept()
+        {
+            for (;;)
+            {
+                int fd = ::accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0)
+                    return fd;
+                if (errno != EINTR)
+                    detail::throw_unix_errno("accept");
+            }
+        }
+
+        const std::string &path() const { return path_; }
+
+      private:
+        std::string path_;
+        int fd_;
+    };
+
+    // One connection, with its endpoint. Not thread-safe: run() and the endpoint belong to one
+    // thread (handlers may call attach_* and take_fd, as they run on that thread).
+    class unix_transport
+    {
+      public:
+        static constexpr std::size_t read_buffer_size = 64 * 1024;
+        static constexpr std::size_t max_fds_per_message = 253; // SCM_MAX_FD
+
+        // Takes ownership of a connected socket (unix_listener::accept or connect)
+        explicit unix_transport(int fd, endpoint_options options = {},
+                                std::size_t max_message_size = 64 * 1024 * 1024)
+            : fd_(fd), codec_(max_message_size), buffer_(new char[read_buffer_size]),
+              needs_poll_(options.batching || options.default_timeout.count() > 0),
+              ep_([this](json &&msg) { write_message(std::move(msg)); }, options)
+        {
+            ep_.set_response_sender([this](response_parts &&r) { write_response(std::move(r)); });
+        }
+
+        ~unix_transport()
+        {
+            for (auto &[token, fd] : attached_)
+                ::close(fd);
+            for (int fd : received_fds_)
+                ::close(fd);
+            close_message_fds();
+            ::close(fd_);
+        }
+
+        unix_transport(const unix_transport &) = delete;
+        unix_transport &operator=(const unix_transport &) = delete;
+
+        static int connect(const std::string &path)
+        {
+            int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+                detail::throw_unix_errno("socket");
+            sockaddr_un addr = detail::unix_address(path);
+            while (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                int err = errno;
+                ::close(fd);
+                throw std::system_error(err, std::generic_category(), "connect " + path);
+            }
+            return fd;
+        }
+
+        endpoint &ep() { return ep_; }
+
+        // Read and dispatch messages until the peer closes (true) or a framing error (false).
+        // Throws std::system_error if reading or writing fails.
+        bool run()
+        {
+            auto dispatch = [this](std::string_view text) { deliver(text); };
+            for (;;)
+            {
+                if (needs_poll_ && !wait_readable())
+                    continue;
+                std::size_t n = read_some();
+                if (n == 0)
+                    return codec_.idle();
+                if (!codec_.decode(std::string_view(buffer_.get(), n), dispatch))
+                    return false;
+            }
+        }
+
+        // Shut down the write side; the peer's run() then returns
+        void shutdown() { ::shutdown(fd_, SHUT_WR); }
+
+        // --- Sending descriptors ---
+
+        // Hand `fd` (ownership included) to the next outgoing message that contains the
+        // returned reference, e.g. as (part of) a handler's result
+        json attach_fd(int fd, std::size_t size = 0)
+        {
+            std::uint64_t token = ++attach_counter_;
+            attached_.emplace(token, fd);
+            return json{{"$fd", token}, {"size", size}};
+        }
+
+        // A sealed memfd of `size` bytes filled in place by fill(char *), attached as above.
+        // The receiver maps the same pages, so the payload is written exactly once.
+        template <typename Fill> json attach_blob(std::size_t size, Fill &&fill)
+        {
+            int fd = ::memfd_create("jsonrpc-blob", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+            if (fd < 0)
+                detail::throw_unix_errno("memfd_create");
+            try
+            {
+                if (::ftruncate(fd, static_cast<off_t>(size)) != 0)
+                    detail::throw_unix_errno("ftruncate");
+                if (size != 0)
+                {
+                    void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                    if (p == MAP_FAILED)
+                        detail::throw_unix_errno("mmap");
+                    struct unmap
+                    {
+                        void *p;
+                        std::size_t size;
+                        ~unmap() { ::munmap(p, size); }
+                    } guard{p, size};
+                    fill(static_cast<char *>(p));
+                }
+                // Sealed, so the receiver can rely on the contents not changing under it
+                ::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+            }
+            catch (...)
+            {
+                ::close(fd);
+                throw;
+            }
+            return attach_fd(fd, size);
+        }
+
+        json attach_blob(std::string_view bytes)
+        {
+            return attach_blob(bytes.size(),
+                               [&](char *dst) { std::memcpy(dst, bytes.data(), bytes.size()); });
+        }
+
+        // --- Receiving descriptors ---
+
+        // Claim the descriptor behind a reference in the message being handled (valid only
+        // during its handler or callback; unclaimed descriptors are closed afterwards).
+        // Returns -1 if `ref` is not a reference received with that message.
+        int take_fd(const json &ref)
+        {
+            if (!ref.is_object() || !ref.contains("$fd") || !ref["$fd"].is_number_integer())
+                return -1;
+            int fd = ref["$fd"].get<int>();
+            for (auto &owned : message_fds_)
+            {
+                if (owned == fd)
+                {
+                    owned = -1;
+                    return fd;
+                }
+            }
+            return -1;
+        }
+
+      private:
+        std::size_t read_some()
+        {
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_fds_per_message)];
+            iovec iov{buffer_.get(), read_buffer_size};
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            for (;;)
+            {
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof(control);
+                ssize_t n = ::recvmsg(fd_, &msg, MSG_CMSG_CLOEXEC);
+                if (n < 0)
+                {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                        wait_for(POLLIN, -1);
+                    else if (errno != EINTR)
+                        detail::throw_unix_errno("recvmsg");
+                    continue;
+                }
+                // Descriptors arrive with the first bytes of the message that carries them
+                for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+                {
+                    if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+                        continue;
+                    std::size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                    for (std::size_t i = 0; i < count; ++i)
+                    {
+                        int fd;
+                        std::memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+                        received_fds_.push_back(fd);
+                    }
+                }
+                if (msg.msg_flags & MSG_CTRUNC)
+                    throw std::system_error(EPROTO, std::generic_category(), "descriptors lost");
+                return static_cast<std::size_t>(n);
+            }
+        }
+
+        // Messages without descriptors pending go straight to the endpoint's parser; only
+        // while some are queued is the message parsed here and searched for references
+        void deliver(std::string_view text)
+        {
+            if (received_fds_.empty())
+            {
+                ep_.receive_raw(text);
+                return;
+            }
+            json msg = json::parse(text, nullptr, false);
+            if (msg.is_discarded())
+            {
+                ep_.receive_raw(text); // reports the parse error
+                return;
+            }
+            std::size_t used = 0;
+            bind_fds(msg, used);
+            for (std::size_t i = 0; i < used; ++i)
+            {
+                message_fds_.push_back(received_fds_.front());
+                received_fds_.pop_front();
+            }
+            ep_.receive(std::move(msg));
+            close_message_fds();
+        }
+
+        // Replace positional references with the local descriptor numbers
+        void bind_fds(json &value, std::size_t &used)
+        {
+            if (value.is_object())
+            {
+                auto it = value.find("$fd");
+                if (it != value.end() && it->is_number_unsigned())
+                {
+                    auto index = it->get<std::size_t>();
+                    if (index < received_fds_.size())
+                    {
+                        *it = received_fds_[index];
+                        used = std::max(used, index + 1);
+                    }
+                    return;
+                }
+                for (auto &member : value)
+                    bind_fds(member, used);
+            }
+            else if (value.is_array())
+            {
+                for (auto &element : value)
+                    bind_fds(element, used);
+            }
+        }
+
+        void close_message_fds()
+        {
+            for (int fd : message_fds_)
+                if (fd >= 0)
+                    ::close(fd);
+            message_fds_.clear();
+        }
+
+        // Replace attachment tokens with positions and collect the descriptors, in document
+        // order (which the receiver walks identically)
+        void collect_fds(json &value, std::vector<int> &fds)
+        {
+            if (value.is_object())
+            {
+                auto it = value.find("$fd");
+                if (it != value.end() && it->is_number_unsigned())
+                {
+                    auto found = attached_.find(it->get<std::uint64_t>());
+                    if (found != attached_.end())
+                    {
+                        *it = fds.size();
+                        fds.push_back(found->second);
+                        attached_.erase(found);
+                    }
+                    return;
+                }
+                for (auto &member : value)
+                    collect_fds(member, fds);
+            }
+            else if (value.is_array())
+            {
+                for (auto &element : value)
+                    collect_fds(element, fds);
+            }
+        }
+
+        void write_message(json &&msg)
+        {
+            std::vector<int> fds;
+            if (!attached_.empty())
+                collect_fds(msg, fds);
+            if (fds.size() > max_fds_per_message)
+                throw std::system_error(EMSGSIZE, std::generic_category(), "too many fds");
+            out_.clear();
+            codec_.encode(msg, out_);
+            send_out(fds);
+        }
+
+        // Written unrendered, unless attached descriptors may have to be renumbered in it
+        void write_response(response_parts &&r)
+        {
+            if (!attached_.empty())
+            {
+                write_message(std::move(r).to_json());
+                return;
+            }
+            out_.clear();
+            codec_.encode(r, out_);
+            std::vector<int> fds;
+            send_out(fds);
+        }
+
+        void send_out(const std::vector<int> &fds)
+        {
+            std::size_t offset = 0;
+            if (!fds.empty())
+            {
+                // The descriptors ride on the first chunk; the kernel holds its own references
+                // once sendmsg succeeds, so ours are closed either way
+                alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_fds_per_message)];
+                iovec iov{out_.data(), out_.size()};
+                msghdr m{};
+                m.msg_iov = &iov;
+                m.msg_iovlen = 1;
+                m.msg_control = control;
+                m.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+                cmsghdr *c = CMSG_FIRSTHDR(&m);
+                c->cmsg_level = SOL_SOCKET;
+                c->cmsg_type = SCM_RIGHTS;
+                c->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+                std::memcpy(CMSG_DATA(c), fds.data(), sizeof(int) * fds.size());
+                ssize_t n;
+                while ((n = ::sendmsg(fd_, &m, MSG_NOSIGNAL)) < 0)
+                {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                        wait_for(POLLOUT, -1);
+                    else if (errno != EINTR)
+                        break;
+                }
+                int err = errno;
+                for (int fd : fds)
+                    ::close(fd);
+                if (n < 0)
+                    throw std::system_error(err, std::generic_category(), "sendmsg");
+                offset = static_cast<std::size_t>(n);
+            }
+            while (offset < out_.size())
+            {
+                ssize_t n = ::send(fd_, out_.data() + offset, out_.size() - offset, MSG_NOSIGNAL);
+                if (n >= 0)
+                    offset += static_cast<std::size_t>(n);
+                else if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    wait_for(POLLOUT, -1);
+                else if (errno != EINTR)
+                    detail::throw_unix_errno("send");
+            }
+        }
+
+        // With timers to run, wake at least every millisecond for endpoint::poll
+        bool wait_readable()
+        {
+            bool ready = wait_for(POLLIN, 1);
+            ep_.poll();
+            return ready;
+        }
+
+        bool wait_for(short events, int timeout_ms)
+        {
+            pollfd p{fd_, events, 0};
+            return ::poll(&p, 1, timeout_ms) > 0;
+        }
+
+        int fd_;
+        ndjson_codec codec_;
+        std::unique_ptr<char[]> buffer_;
+        std::string out_;
+        std::uint64_t attach_counter_ = 0;
+        std::unordered_map<std::uint64_t, int> attached_; // token -> descriptor to send
+        std::deque<int> received_fds_;                    // not yet matched to a message
+        std::vector<int> message_fds_;                    // owned by the message in dispatch
+        bool needs_poll_;
+        endpoint ep_;
+    };
+
+} // namespace pooriayousefi
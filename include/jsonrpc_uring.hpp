@@ -0,0 +1,277 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+// Minimal io_uring ring over the raw syscalls (no liburing dependency), used by the
+// io_uring reactor in jsonrpc_tcp.hpp.
+
+namespace pooriayousefi
+{
+    namespace detail
+    {
+
+        class uring
+        {
+          public:
+            // Throws std::system_error when io_uring is unavailable (old kernel, disabled by
+            // sysctl or seccomp) or lacks what the reactor needs: multishot accept/recv and
+            // provided buffer rings (Linux 6.0+), and timed waits (IORING_FEAT_EXT_ARG).
+            uring(unsigned entries, unsigned cq_entries)
+            {
+                io_uring_params p{};
+                p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+                p.cq_entries = cq_entries;
+                fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+                if (fd_ < 0 && errno == EINVAL)
+                {
+                    p = io_uring_params{};
+                    p.flags = IORING_SETUP_CQSIZE;
+                    p.cq_entries = cq_entries;
+                    fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+                }
+                if (fd_ < 0)
+                    fail("io_uring_setup");
+                const unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+                                        IORING_FEAT_EXT_ARG;
+                if ((p.features & needed) != needed || !supports(IORING_OP_SEND_ZC))
+                {
+                    errno = ENOSYS; // SEND_ZC came with multishot recv, in 6.0
+                    fail("io_uring features");
+                }
+
+                ring_size_ = std::max(p.sq_off.array + p.sq_entries * sizeof(std::uint32_t),
+                                      p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+                ring_ = ::mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+                if (ring_ == MAP_FAILED)
+                {
+                    ring_ = nullptr;
+                    fail("mmap(sq ring)");
+                }
+                sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+                void *sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+                if (sqes == MAP_FAILED)
+                    fail("mmap(sqes)");
+                sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+                auto *base = static_cast<char *>(ring_);
+                sq_head_ = reinterpret_cast<unsigned *>(base + p.sq_off.head);
+                sq_tail_ = reinterpret_cast<unsigned *>(base + p.sq_off.tail);
+                sq_mask_ = *reinterpret_cast<unsigned *>(base + p.sq_off.ring_mask);
+                sq_entries_ = p.sq_entries;
+                cq_head_ = reinterpret_cast<unsigned *>(base + p.cq_off.head);
+                cq_tail_ = reinterpret_cast<unsigned *>(base + p.cq_off.tail);
+                cq_mask_ = *reinterpret_cast<unsigned *>(base + p.cq_off.ring_mask);
+                cqes_ = reinterpret_cast<io_uring_cqe *>(base + p.cq_off.cqes);
+                // SQ slot i always maps to SQE i
+                auto *array = reinterpret_cast<unsigned *>(base + p.sq_off.array);
+                for (unsigned i = 0; i < p.sq_entries; ++i)
+                    array[i] = i;
+                local_tail_ = *sq_tail_;
+            }
+
+            ~uring() { close(); }
+
+            uring(const uring &) = delete;
+            uring &operator=(const uring &) = delete;
+
+            int fd() const { return fd_; }
+
+            // Tear the ring down, cancelling whatever is still in flight
+            void close()
+            {
+                if (sqes_)
+                    ::munmap(sqes_, sqes_size_);
+                if (ring_)
+                    ::munmap(ring_, ring_size_);
+                if (fd_ >= 0)
+                    ::close(fd_);
+                sqes_ = nullptr;
+                ring_ = nullptr;
+                fd_ = -1;
+            }
+
+            // Next free SQE, zeroed. Submits queued entries first if the queue is full.
+            io_uring_sqe *get_sqe()
+            {
+                while (local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+                    enter(0, 0, nullptr);
+                io_uring_sqe *sqe = &sqes_[local_tail_ & sq_mask_];
+                std::memset(sqe, 0, sizeof(*sqe));
+                ++local_tail_;
+                return sqe;
+            }
+
+            // Submit everything queued and wait for at least one completion, or until timeout_ns
+            // (negative: no timeout) elapses
+            void submit_and_wait(long long timeout_ns)
+            {
+                if (timeout_ns < 0)
+                {
+                    enter(1, IORING_ENTER_GETEVENTS, nullptr);
+                    return;
+                }
+                __kernel_timespec ts{};
+                ts.tv_sec = timeout_ns / 1000000000;
+                ts.tv_nsec = timeout_ns % 1000000000;
+                io_uring_getevents_arg arg{};
+                arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+                enter(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg);
+            }
+
+            // Call fn(const io_uring_cqe&) for each ready completion; returns how many
+            template <typename F> unsigned for_each_completion(F &&fn)
+            {
+                unsigned head = *cq_head_;
+                unsigned count = 0;
+                for (;;)
+                {
+                    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+                    if (head == tail)
+                        break;
+                    for (; head != tail; ++head, ++count)
+                    {
+                        io_uring_cqe cqe = cqes_[head & cq_mask_];
+                        // Release the slot before the handler runs: it may queue more work
+                        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+                        fn(cqe);
+                    }
+                }
+                return count;
+            }
+
+            int register_op(unsigned opcode, void *arg, unsigned count)
+            {
+                return static_cast<int>(::syscall(__NR_io_uring_register, fd_, opcode, arg, count));
+            }
+
+          private:
+            [[noreturn]] void fail(const char *what)
+            {
+                int err = errno;
+                close();
+                throw std::system_error(err, std::generic_category(), what);
+            }
+
+            bool supports(unsigned op)
+            {
+                std::vector<char> buf(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+                auto *probe = reinterpret_cast<io_uring_probe *>(buf.data());
+                if (register_op(IORING_REGISTER_PROBE, probe, 256) < 0 || probe->last_op < op)
+                    return false;
+                return (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+            }
+
+            void enter(unsigned min_complete, unsigned flags, io_uring_getevents_arg *arg)
+            {
+                __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+                unsigned pending = local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+                long r = ::syscall(__NR_io_uring_enter, fd_, pending, min_complete, flags, arg,
+                                   arg ? sizeof(*arg) : 0);
+                // ETIME: timed out; EINTR: signal; EBUSY/EAGAIN: completions must be reaped first
+                if (r < 0 && errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+                    throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+            }
+
+            int fd_ = -1;
+            void *ring_ = nullptr;
+            std::size_t ring_size_ = 0;
+            io_uring_sqe *sqes_ = nullptr;
+            std::size_t sqes_size_ = 0;
+            unsigned *sq_head_ = nullptr;
+            unsigned *sq_tail_ = nullptr;
+            unsigned sq_mask_ = 0;
+            unsigned sq_entries_ = 0;
+            unsigned local_tail_ = 0;
+            unsigned *cq_head_ = nullptr;
+            unsigned *cq_tail_ = nullptr;
+            unsigned cq_mask_ = 0;
+            io_uring_cqe *cqes_ = nullptr;
+        };
+
+        // Provided buffer ring: a pool of receive buffers registered with the kernel, which picks
+        // one per completion of a buffer-select recv. Buffers are handed back with recycle().
+        class uring_buffer_ring
+        {
+          public:
+            // count must be a power of two
+            uring_buffer_ring(uring &ring, std::uint16_t group, unsigned count, unsigned size)
+                : group_(group), count_(count), size_(size), storage_(new char[count * size])
+            {
+                ring_bytes_ = count * sizeof(io_uring_buf);
+                void *mem = ::mmap(nullptr, ring_bytes_, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (mem == MAP_FAILED)
+                    throw std::system_error(errno, std::generic_category(), "mmap(buffer ring)");
+                bufs_ = static_cast<io_uring_buf_ring *>(mem);
+                io_uring_buf_reg reg{};
+                reg.ring_addr = reinterpret_cast<std::uint64_t>(bufs_);
+                reg.ring_entries = count;
+                reg.bgid = group;
+                if (ring.register_op(IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+                {
+                    int err = errno;
+                    ::munmap(bufs_, ring_bytes_);
+                    throw std::system_error(err, std::generic_category(), "register buffer ring");
+                }
+                for (unsigned i = 0; i < count; ++i)
+                    put(static_cast<std::uint16_t>(i));
+                publish();
+            }
+
+            ~uring_buffer_ring() { ::munmap(bufs_, ring_bytes_); }
+
+            uring_buffer_ring(const uring_buffer_ring &) = delete;
+            uring_buffer_ring &operator=(const uring_buffer_ring &) = delete;
+
+            std::uint16_t group() const { return group_; }
+            const char *data(std::uint16_t id) const
+            {
+                return storage_.get() + std::size_t(id) * size_;
+            }
+
+            void recycle(std::uint16_t id)
+            {
+                put(id);
+                publish();
+            }
+
+          private:
+            void put(std::uint16_t id)
+            {
+                // Index by hand: in C++ the header's flexible-array wrapper shifts bufs[]
+                io_uring_buf &b = reinterpret_cast<io_uring_buf *>(bufs_)[tail_ & (count_ - 1)];
+                b.addr = reinterpret_cast<std::uint64_t>(storage_.get() + std::size_t(id) * size_);
+                b.len = size_;
+                b.bid = id;
+                ++tail_;
+            }
+
+            void publish() { __atomic_store_n(&bufs_->tail, tail_, __ATOMIC_RELEASE); }
+
+            std::uint16_t group_;
+            unsigned count_;
+            unsigned size_;
+            std::unique_ptr<char[]> storage_;
+            io_uring_buf_ring *bufs_ = nullptr;
+            std::size_t ring_bytes_ = 0;
+            std::uint16_t tail_ = 0;
+        };
+
+    } // namespace detail
+} // namespace pooriayousefi
@@ -0,0 +1,862 @@
+#pragma once
+
+#include "jsonrpc.hpp"
+#include "jsonrpc_framing.hpp"
+#include "jsonrpc_http.hpp"
+#include "jsonrpc_tcp.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+// JSON-RPC over WebSocket (RFC 6455): a websocket_codec for the TCP server (websocket_server)
+// and a client. Each JSON-RPC message is one text message; incoming fragments are reassembled
+// (and unmasked) into one reusable buffer, and outgoing messages are serialized straight into
+// fragments rather than into a separate string first.
+
+namespace pooriayousefi
+{
+
+    namespace detail
+    {
+        inline std::array<std::uint8_t, 20> sha1(std::string_view data)
+        {
+            std::uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+            auto block = [&h](const std::uint8_t *p)
+            {
+                std::uint32_t w[80];
+                for (int i = 0; i < 16; ++i)
+                    w[i] = std::uint32_t(p[4 * i]) << 24 | std::uint32_t(p[4 * i + 1]) << 16 |
+                           std::uint32_t(p[4 * i + 2]) << 8 | p[4 * i + 3];
+                for (int i = 16; i < 80; ++i)
+                    w[i] = std::rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+                std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+                for (int i = 0; i < 80; ++i)
+                {
+                    std::uint32_t f, k;
+                    if (i < 20)
+                        f = (b & c) | (~b & d), k = 0x5a827999;
+                    else if (i < 40)
+                        f = b ^ c ^ d, k = 0x6ed9eba1;
+                    else if (i < 60)
+                        f = (b & c) | (b & d) | (c & d), k = 0x8f1bbcdc;
+                    else
+                        f = b ^ c ^ d, k = 0xca62c1d6;
+                    std::uint32_t t = std::rotl(a, 5) + f + e + k + w[i];
+                    e = d;
+                    d = c;
+                    c = std::rotl(b, 30);
+                    b = a;
+                    a = t;
+                }
+                h[0] += a;
+                h[1] += b;
+                h[2] += c;
+                h[3] += d;
+                h[4] += e;
+            };
+
+            const auto *p = reinterpret_cast<const std::uint8_t *>(data.data());
+            std::size_t n = data.size();
+            for (; n >= 64; n -= 64, p += 64)
+                block(p);
+            std::uint8_t tail[128] = {};
+            std::memcpy(tail, p, n);
+            tail[n] = 0x80;
+            std::size_t padded = n < 56 ? 64 : 128;
+            std::uint64_t bits = std::uint64_t(data.size()) * 8;
+            for (int i = 0; i < 8; ++i)
+                tail[padded - 1 - i] = static_cast<std::uint8_t>(bits >> (8 * i));
+            block(tail);
+            if (padded == 128)
+                block(tail + 64);
+
+            std::array<std::uint8_t, 20> digest;
+            for (int i = 0; i < 20; ++i)
+                digest[i] = static_cast<std::uint8_t>(h[i / 4] >> (24 - 8 * (i % 4)));
+            return digest;
+        }
+
+        inline std::string base64_encode(const std::uint8_t *p, std::size_t n)
+        {
+            static constexpr char alphabet[] =
+                "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            std::string out;
+            out.reserve((n + 2) / 3 * 4);
+            for (std::size_t i = 0; i < n; i += 3)
+            {
+                std::uint32_t v = std::uint32_t(p[i]) << 16;
+                if (i + 1 < n)
+                    v |= std::uint32_t(p[i + 1]) << 8;
+                if (i + 2 < n)
+                    v |= p[i + 2];
+                out += alphabet[v >> 18 & 63];
+                out += alphabet[v >> 12 & 63];
+                out += i + 1 < n ? alphabet[v >> 6 & 63] : '=';
+                out += i + 2 < n ? alphabet[v & 63] : '=';
+            }
+            return out;
+        }
+
+        // Sec-WebSocket-Accept for a Sec-WebSocket-Key
+        inline std::string websocket_accept(std::string_view key)
+        {
+            std::string text(key);
+            text += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+            auto digest = sha1(text);
+            return base64_encode(digest.data(), digest.size());
+        }
+
+        // Value of a header field in a raw HTTP head ("" if absent)
+        inline std::string_view http_field(std::string_view head, std::string_view name)
+        {
+            for (std::size_t eol; (eol = head.find("\r\n")) != std::string_view::npos;)
+            {
+                std::string_view field = head.substr(0, eol);
+                head.remove_prefix(eol + 2);
+                std::size_t colon = field.find(':');
+                if (colon == std::string_view::npos || !ascii_iequals(field.substr(0, colon), name))
+                    continue;
+                std::string_view value = field.substr(colon + 1);
+                while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+                    value.remove_prefix(1);
+                while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+                    value.remove_suffix(1);
+                return value;
+            }
+            return {};
+        }
+
+        // Whether a comma-separated header value lists `token`
+        inline bool http_has_token(std::string_view value, std::string_view token)
+        {
+            while (!value.empty())
+            {
+                std::size_t comma = value.find(',');
+                std::string_view item = value.substr(0, comma);
+                while (!item.empty() && item.front() == ' ')
+                    item.remove_prefix(1);
+                while (!item.empty() && item.back() == ' ')
+                    item.remove_suffix(1);
+                if (ascii_iequals(item, token))
+                    return true;
+                if (comma == std::string_view::npos)
+                    break;
+                value.remove_prefix(comma + 1);
+            }
+            return false;
+        }
+
+        // Masking. A kernel XORs n bytes of src with the repeating 4-byte key into dst (which
+        // may be src); `key` is the masking key already rotated so that its first byte (in
+        // memory order) applies to src[0]. The vector kernels do 64 bytes per step.
+        using unmask_kernel = void (*)(char *dst, const char *src, std::size_t n,
+                                       std::uint32_t key);
+
+        inline void unmask_tail(char *dst, const char *src, std::size_t i, std::size_t n,
+                                std::uint32_t key)
+        {
+            std::uint8_t bytes[4];
+            std::memcpy(bytes, &key, 4);
+            for (; i < n; ++i)
+                dst[i] = static_cast<char>(src[i] ^ bytes[i & 3]);
+        }
+
+        inline void unmask_scalar(char *dst, const char *src, std::size_t n, std::uint32_t key)
+        {
+            std::uint64_t wide = std::uint64_t(key) | std::uint64_t(key) << 32;
+            if constexpr (std::endian::native == std::endian::big)
+                wide = std::uint64_t(key) << 32 | key;
+            std::size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, src + i, 8);
+                word ^= wide;
+                std::memcpy(dst + i, &word, 8);
+            }
+            unmask_tail(dst, src, i, n, key);
+        }
+
+#ifdef JSONRPC_X86_SIMD
+        __attribute__((target("sse2"))) inline void unmask_sse2(char *dst, const char *src,
+                                                                std::size_t n, std::uint32_t key)
+        {
+            const __m128i k = _mm_set1_epi32(static_cast<int>(key));
+            std::size_t i = 0;
+            for (; i + 64 <= n; i += 64)
+            {
+                for (std::size_t j = 0; j < 64; j += 16)
+                {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + j));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + j), _mm_xor_si128(v, k));
+                }
+            }
+            unmask_scalar(dst + i, src + i, n - i, key);
+        }
+
+        __attribute__((target("avx2"))) inline void unmask_avx2(char *dst, const char *src,
+                                                                std::size_t n, std::uint32_t key)
+        {
+            const __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+            std::size_t i = 0;
+            for (; i + 64 <= n; i += 64)
+            {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 32));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(a, k));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 32),
+                                    _mm256_xor_si256(b, k));
+            }
+            unmask_scalar(dst + i, src + i, n - i, key);
+        }
+#endif
+
+        // Best kernel for this CPU, picked once
+        inline unmask_kernel unmasker()
+        {
+            static const unmask_kernel kernel = []
+            {
+#ifdef JSONRPC_X86_SIMD
+                if (__builtin_cpu_supports("avx2"))
+                    return unmask_avx2;
+                if (__builtin_cpu_supports("sse2"))
+                    return unmask_sse2;
+#endif
+                return unmask_scalar;
+            }();
+            return kernel;
+        }
+
+        // The key rotated to start `offset` bytes into the masked payload
+        inline std::uint32_t rotate_mask(std::uint32_t key, std::size_t offset)
+        {
+            unsigned shift = 8 * unsigned(offset & 3);
+            return std::endian::native == std::endian::little ? std::rotr(key, int(shift))
+                                                               : std::rotl(key, int(shift));
+        }
+
+        enum ws_opcode : std::uint8_t
+        {
+            ws_continuation = 0x0,
+            ws_text = 0x1,
+            ws_binary = 0x2,
+            ws_close = 0x8,
+            ws_ping = 0x9,
+            ws_pong = 0xa
+        };
+
+        // Incremental frame parser. Data messages, fragmented or not, come out whole through
+        // on_message(std::string_view); control frames through on_control(opcode, payload).
+        // An unmasked single-frame message that arrived in one read is handed out in place;
+        // everything else is assembled in one buffer that keeps its capacity, unmasked on the
+        // way in. Returns false on a protocol violation.
+        class ws_frame_parser
+        {
+          public:
+            ws_frame_parser(bool masked, std::size_t max_message_size)
+                : masked_(masked), max_message_size_(max_message_size)
+            {
+            }
+
+            // A close frame is the last one of the stream: nothing after it is parsed
+            template <typename M, typename C>
+            bool feed(std::string_view bytes, M &&on_message, C &&on_control)
+            {
+                while (!closed_ && (!bytes.empty() || (in_frame_ && remaining_ == 0)))
+                {
+                    if (!in_frame_)
+                    {
+                        if (!take_header(bytes))
+                            return true;
+                        if (!start_frame())
+                            return false;
+                        continue;
+                    }
+                    if (opcode_ & 0x8)
+                    {
+                        // Control payloads are at most 125 bytes
+                        std::size_t take = std::min(remaining_, bytes.size());
+                        append(control_, control_length_, bytes.substr(0, take));
+                        control_length_ += take;
+                        bytes.remove_prefix(take);
+                        remaining_ -= take;
+                        if (remaining_ != 0)
+                            return true;
+                        in_frame_ = false;
+                        closed_ = opcode_ == ws_close;
+                        on_control(opcode_, std::string_view(control_, control_length_));
+                        continue;
+                    }
+                    if (!masked_ && fin_ && length_ == 0 && bytes.size() >= remaining_)
+                    {
+                        std::string_view payload = bytes.substr(0, remaining_);
+                        bytes.remove_prefix(remaining_);
+                        in_frame_ = false;
+                        in_message_ = false;
+                        on_message(payload);
+                        continue;
+                    }
+                    std::size_t take = std::min(remaining_, bytes.size());
+                    append(buffer_.get(), length_, bytes.substr(0, take));
+                    length_ += take;
+                    bytes.remove_prefix(take);
+                    remaining_ -= take;
+                    if (remaining_ != 0)
+                        return true;
+                    in_frame_ = false;
+                    if (fin_)
+                    {
+                        in_message_ = false;
+                        std::size_t length = std::exchange(length_, 0);
+                        on_message(std::string_view(buffer_.get(), length));
+                    }
+                }
+                return true;
+            }
+
+          private:
+            // Gather the 2-14 header bytes, which may arrive split
+            bool take_header(std::string_view &bytes)
+            {
+                while (!bytes.empty())
+                {
+                    std::size_t need = header_size();
+                    if (header_length_ >= need)
+                        return true;
+                    std::size_t take = std::min(need - header_length_, bytes.size());
+                    std::memcpy(header_ + header_length_, bytes.data(), take);
+                    header_length_ += take;
+                    bytes.remove_prefix(take);
+                }
+                return header_length_ >= 2 && header_length_ >= header_size();
+            }
+
+            std::size_t header_size() const
+            {
+                if (header_length_ < 2)
+                    return 2;
+                std::size_t size = 2 + ((header_[1] & 0x80) ? 4 : 0);
+                std::uint8_t len7 = header_[1] & 0x7f;
+                return size + (len7 == 126 ? 2 : len7 == 127 ? 8 : 0);
+            }
+
+            bool start_frame()
+            {
+                const auto *h = reinterpret_cast<const std::uint8_t *>(header_);
+                header_length_ = 0;
+                fin_ = h[0] & 0x80;
+                opcode_ = h[0] & 0x0f;
+                bool masked = h[1] & 0x80;
+                if ((h[0] & 0x70) || masked != masked_)
+                    return false;
+                std::uint64_t length = h[1] & 0x7f;
+                std::size_t at = 2;
+                std::size_t ext = length == 126 ? 2 : length == 127 ? 8 : 0;
+                if (ext != 0)
+                    length = 0;
+                for (; ext > 0; --ext)
+                    length = length << 8 | h[at++];
+                if (masked)
+                    std::memcpy(&key_, h + at, 4);
+                offset_ = 0;
+                remaining_ = static_cast<std::size_t>(length);
+
+                if (opcode_ & 0x8)
+                {
+                    if (!fin_ || length > 125 || opcode_ > ws_pong)
+                        return false;
+                    control_length_ = 0;
+                }
+                else
+                {
+                    if (opcode_ > ws_binary || (opcode_ == ws_continuation) != in_message_ ||
+                        length > max_message_size_ - length_)
+                        return false;
+                    in_message_ = true;
+                    reserve(length_ + remaining_);
+                }
+                in_frame_ = true;
+                return true;
+            }
+
+            void reserve(std::size_t size)
+            {
+                if (size <= capacity_)
+                    return;
+                std::size_t grown = std::max(size, capacity_ * 2);
+                std::unique_ptr<char[]> bigger(new char[grown]);
+                if (length_ != 0)
+                    std::memcpy(bigger.get(), buffer_.get(), length_);
+                buffer_ = std::move(bigger);
+                capacity_ = grown;
+            }
+
+            // Copy payload bytes to dst + at, unmasking them on the way
+            void append(char *dst, std::size_t at, std::string_view bytes)
+            {
+                if (bytes.empty())
+                    return;
+                if (!masked_)
+                {
+                    std::memcpy(dst + at, bytes.data(), bytes.size());
+                    return;
+                }
+                unmasker()(dst + at, bytes.data(), bytes.size(), rotate_mask(key_, offset_));
+                offset_ += bytes.size();
+            }
+
+            bool masked_;
+            std::size_t max_message_size_;
+            char header_[14];
+            std::size_t header_length_ = 0;
+            bool in_frame_ = false;
+            bool in_message_ = false;
+            bool closed_ = false;
+            bool fin_ = false;
+            std::uint8_t opcode_ = 0;
+            std::uint32_t key_ = 0;
+            std::size_t offset_ = 0; // into the current frame's payload, for the mask phase
+            std::size_t remaining_ = 0;
+            std::unique_ptr<char[]> buffer_;
+            std::size_t capacity_ = 0;
+            std::size_t length_ = 0; // message bytes assembled so far
+            char control_[125];
+            std::size_t control_length_ = 0;
+        };
+
+        // Serializer output that frames a message as WebSocket fragments in place. Each
+        // fragment's header is reserved at its largest and fixed up once the fragment is
+        // full (or the message ends); a short last fragment is moved down to the minimal
+        // header. Client frames are masked as they are closed.
+        struct ws_fragment_output : nlohmann::detail::output_adapter_protocol<char>
+        {
+            static constexpr std::size_t fragment_size = 16 * 1024;
+
+            ws_fragment_output(std::string &o, std::mt19937 *masking) : out(o), rng(masking)
+            {
+                open();
+            }
+
+            void write_character(char c) override
+            {
+                out.push_back(c);
+                if (out.size() - data_start() >= fragment_size)
+                    next();
+            }
+
+            void write_characters(const char *s, std::size_t length) override
+            {
+                while (length > 0)
+                {
+                    std::size_t take =
+                        std::min(length, fragment_size - (out.size() - data_start()));
+                    out.append(s, take);
+                    s += take;
+                    length -= take;
+                    if (out.size() - data_start() >= fragment_size)
+                        next();
+                }
+            }
+
+            void finish() { close(true); }
+
+          private:
+            std::size_t header_room() const { return rng ? 8 : 4; }
+            std::size_t data_start() const { return start + header_room(); }
+
+            void open()
+            {
+                start = out.size();
+                out.append(header_room(), '\0');
+            }
+
+            void close(bool fin)
+            {
+                std::size_t size = out.size() - data_start();
+                std::size_t header = (size < 126 ? 2 : 4) + (rng ? 4 : 0);
+                if (header < header_room())
+                {
+                    std::memmove(out.data() + start + header, out.data() + data_start(), size);
+                    out.resize(start + header + size);
+                }
+                auto *h = reinterpret_cast<unsigned char *>(out.data() + start);
+                h[0] = static_cast<unsigned char>((fin ? 0x80 : 0) | (first ? ws_text : 0));
+                std::size_t at = 2;
+                if (size < 126)
+                {
+                    h[1] = static_cast<unsigned char>(size);
+                }
+                else
+                {
+                    h[1] = 126;
+                    h[2] = static_cast<unsigned char>(size >> 8);
+                    h[3] = static_cast<unsigned char>(size);
+                    at = 4;
+                }
+                if (rng)
+                {
+                    h[1] |= 0x80;
+                    std::uint32_t key = static_cast<std::uint32_t>((*rng)());
+                    std::memcpy(h + at, &key, 4);
+                    char *data = out.data() + start + header;
+                    unmasker()(data, data, size, key);
+                }
+                first = false;
+            }
+
+            void next()
+            {
+                close(false);
+                open();
+            }
+
+            std::string &out;
+            std::mt19937 *rng;
+            std::size_t start = 0;
+            bool first = true;
+        };
+
+        // One text message (json or response_parts), serialized straight into frames
+        // appended to out
+        template <typename M>
+        void ws_write_message(const M &msg, std::string &out, std::mt19937 *masking)
+        {
+            auto frames = std::make_shared<ws_fragment_output>(out, masking);
+            json_serializer serializer(frames, ' ');
+            write_message(serializer, *frames, msg);
+            frames->finish();
+        }
+
+        // A control frame (close, ping, pong) with a payload of at most 125 bytes
+        inline void ws_write_control(std::uint8_t opcode, std::string_view payload,
+                                     std::string &out, std::mt19937 *masking)
+        {
+            out += static_cast<char>(0x80 | opcode);
+            out += static_cast<char>((masking ? 0x80 : 0) | payload.size());
+            std::size_t data = out.size();
+            if (!masking)
+            {
+                out += payload;
+                return;
+            }
+            std::uint32_t key = static_cast<std::uint32_t>((*masking)());
+            out.append(reinterpret_cast<const char *>(&key), 4);
+            data += 4;
+            out += payload;
+            unmasker()(out.data() + data, out.data() + data, payload.size(), key);
+        }
+    } // namespace detail
+
+    // Server side of JSON-RPC over WebSocket, for basic_tcp_server (see websocket_server): the
+    // HTTP upgrade handshake, then one endpoint message per text (or binary) message. Pings
+    // are answered; a close frame is echoed and ends the connection.
+    class websocket_codec
+    {
+      public:
+        explicit websocket_codec(std::size_t max_message_size = 64 * 1024 * 1024)
+            : frames_(true, max_message_size)
+        {
+        }
+
+        void attach(std::string &out) { out_ = &out; }
+
+        template <typename F> bool decode(std::string_view bytes, F &&on_message)
+        {
+            if (!open_ && !handshake(bytes))
+                return false;
+            if (!open_)
+                return true;
+            bool ok = frames_.feed(bytes, on_message,
+                                   [this](std::uint8_t opcode, std::string_view payload)
+                                   {
+                                       if (opcode == detail::ws_ping)
+                                           control(detail::ws_pong, payload);
+                                       else if (opcode == detail::ws_close)
+                                           closing_ = true;
+                                   });
+            if (!ok)
+            {
+                control(detail::ws_close, std::string_view("\x03\xea", 2)); // 1002
+                return false;
+            }
+            if (closing_)
+            {
+                control(detail::ws_close, "");
+                return false;
+            }
+            return true;
+        }
+
+        void encode(const json &msg, std::string &out)
+        {
+            if (open_ && !closing_)
+                detail::ws_write_message(msg, out, nullptr);
+        }
+
+        void encode(const response_parts &r, std::string &out)
+        {
+            if (open_ && !closing_)
+                detail::ws_write_message(r, out, nullptr);
+        }
+
+      private:
+        // Gather the upgrade request (it may arrive split) and answer it; the bytes that
+        // follow it are left in `bytes`
+        bool handshake(std::string_view &bytes)
+        {
+            std::size_t old = head_.size();
+            head_.append(bytes.data(), std::min(bytes.size(), max_head_size));
+            std::size_t end = head_.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+            if (end == std::string::npos)
+            {
+                bytes = {};
+                return head_.size() < max_head_size;
+            }
+            bytes.remove_prefix(end + 4 - old);
+            std::string_view head(head_.data(), end + 2);
+            std::string_view key = detail::http_field(head, "Sec-WebSocket-Key");
+            if (head.substr(0, 4) != "GET " || key.empty() ||
+                !detail::http_has_token(detail::http_field(head, "Upgrade"), "websocket") ||
+                detail::http_field(head, "Sec-WebSocket-Version") != "13")
+            {
+                if (out_)
+                    *out_ += "HTTP/1.1 400 Bad Request\r\nSec-WebSocket-Version: 13\r\n"
+                             "Content-Length: 0\r\n\r\n";
+                return false;
+            }
+            if (out_)
+            {
+                *out_ += "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                         "Connection: Upgrade\r\nSec-WebSocket-Accept: ";
+                *out_ += detail::websocket_accept(key);
+                *out_ += "\r\n\r\n";
+            }
+            open_ = true;
+            std::string().swap(head_);
+            return true;
+        }
+
+        void control(std::uint8_t opcode, std::string_view payload)
+        {
+            if (out_)
+                detail::ws_write_control(opcode, payload, *out_, nullptr);
+        }
+
+        static constexpr std::size_t max_head_size = 8 * 1024;
+
+        detail::ws_frame_parser frames_;
+        std::string *out_ = nullptr;
+        std::string head_;
+        bool open_ = false;
+        bool closing_ = false;
+    };
+
+    // WebSocket JSON-RPC server on the TCP reactors (io_uring or epoll)
+    using websocket_server = basic_tcp_server<websocket_codec>;
+
+    // Client side: an endpoint over one WebSocket connection. Outgoing messages are masked
+    // frames buffered until the next wait() (or until enough has accumulated). Not
+    // thread-safe: use from one thread.
+    class websocket_client
+    {
+      public:
+        static constexpr std::size_t read_buffer_size = 64 * 1024;
+        static constexpr std::size_t write_threshold = 64 * 1024;
+
+        // Connects and completes the opening handshake (throws std::system_error on failure)
+        websocket_client(const std::string &host, std::uint16_t port, std::string target = "/",
+                         endpoint_options options = {},
+                         std::size_t max_message_size = 64 * 1024 * 1024)
+            : frames_(false, max_message_size), buffer_(new char[read_buffer_size]),
+              rng_(std::random_device{}()),
+              needs_poll_(options.batching || options.default_timeout.count() > 0),
+              ep_([this](const json &msg) { post(msg); }, options)
+        {
+            fd_ = detail::tcp_connect(host, port);
+            try
+            {
+                handshake(host, port, target);
+            }
+            catch (...)
+            {
+                ::close(fd_);
+                throw;
+            }
+        }
+
+        ~websocket_client() { ::close(fd_); }
+
+        websocket_client(const websocket_client &) = delete;
+        websocket_client &operator=(const websocket_client &) = delete;
+
+        endpoint &ep() { return ep_; }
+
+        // The server closed the connection (or answered our close)
+        bool closed() const { return closed_; }
+
+        // Send what is buffered, then wait up to `timeout` (negative: until something
+        // arrives) and dispatch the messages that came in. Returns how many arrived.
+        std::size_t wait(std::chrono::milliseconds timeout = std::chrono::milliseconds(-1))
+        {
+            if (needs_poll_)
+            {
+                ep_.poll();
+                if (timeout.count() < 0 || timeout.count() > 1)
+                    timeout = std::chrono::milliseconds(1);
+            }
+            flush();
+            if (closed_)
+                return 0;
+            pollfd p{fd_, POLLIN, 0};
+            if (::poll(&p, 1, static_cast<int>(timeout.count())) <= 0)
+                return 0;
+            std::size_t received = 0;
+            for (;;)
+            {
+                ssize_t n = ::recv(fd_, buffer_.get(), read_buffer_size, MSG_DONTWAIT);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    break;
+                if (n <= 0)
+                {
+                    closed_ = true;
+                    break;
+                }
+                if (!receive(std::string_view(buffer_.get(), std::size_t(n)), received))
+                    throw std::system_error(EPROTO, std::generic_category(), "websocket frame");
+                if (closed_ || std::size_t(n) < read_buffer_size)
+                    break;
+            }
+            flush(); // pongs and the close reply
+            return received;
+        }
+
+        // Start the closing handshake; wait() until closed() for the server's reply
+        void close()
+        {
+            if (close_sent_ || closed_)
+                return;
+            close_sent_ = true;
+            detail::ws_write_control(detail::ws_close, std::string_view("\x03\xe8", 2), out_,
+                                     &rng_); // 1000
+            flush();
+        }
+
+      private:
+        void handshake(const std::string &host, std::uint16_t port, const std::string &target)
+        {
+            std::uint8_t nonce[16];
+            for (auto &b : nonce)
+                b = static_cast<std::uint8_t>(rng_());
+            std::string key = detail::base64_encode(nonce, sizeof(nonce));
+            out_ = "GET " + target + " HTTP/1.1\r\nHost: " + host + ":" + std::to_string(port) +
+                   "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: " + key +
+                   "\r\nSec-WebSocket-Version: 13\r\n\r\n";
+            flush();
+
+            std::string head;
+            std::size_t end;
+            while ((end = head.find("\r\n\r\n")) == std::string::npos)
+            {
+                if (head.size() > 8 * 1024)
+                    throw std::system_error(EPROTO, std::generic_category(), "websocket upgrade");
+                ssize_t n = ::recv(fd_, buffer_.get(), read_buffer_size, 0);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    throw std::system_error(n == 0 ? ECONNRESET : errno, std::generic_category(),
+                                            "websocket upgrade");
+                head.append(buffer_.get(), std::size_t(n));
+            }
+            std::string_view fields(head.data(), end + 2);
+            if (fields.substr(0, 12) != "HTTP/1.1 101" ||
+                detail::http_field(fields, "Sec-WebSocket-Accept") !=
+                    detail::websocket_accept(key))
+                throw std::system_error(EPROTO, std::generic_category(), "websocket upgrade");
+            // Frames the server sent right behind its answer
+            std::size_t received = 0;
+            if (!receive(std::string_view(head).substr(end + 4), received))
+                throw std::system_error(EPROTO, std::generic_category(), "websocket frame");
+        }
+
+        bool receive(std::string_view bytes, std::size_t &received)
+        {
+            return frames_.feed(
+                bytes,
+                [&](std::string_view text)
+                {
+                    ++received;
+                    ep_.receive_raw(text);
+                },
+                [&](std::uint8_t opcode, std::string_view payload)
+                {
+                    if (opcode == detail::ws_ping)
+                    {
+                        detail::ws_write_control(detail::ws_pong, payload, out_, &rng_);
+                    }
+                    else if (opcode == detail::ws_close)
+                    {
+                        if (!close_sent_)
+                            detail::ws_write_control(detail::ws_close, payload.substr(0, 2),
+                                                     out_, &rng_);
+                        close_sent_ = true;
+                        closed_ = true;
+                    }
+                });
+        }
+
+        void post(const json &msg)
+        {
+            if (close_sent_)
+                return;
+            detail::ws_write_message(msg, out_, &rng_);
+            if (out_.size() >= write_threshold)
+                flush();
+        }
+
+        void flush()
+        {
+            std::size_t offset = 0;
+            while (offset < out_.size())
+            {
+                ssize_t n = ::send(fd_, out_.data() + offset, out_.size() - offset, MSG_NOSIGNAL);
+                if (n >= 0)
+                    offset += static_cast<std::size_t>(n);
+                else if (errno == EPIPE || errno == ECONNRESET)
+                    closed_ = true;
+                else if (errno != EINTR)
+                    throw std::system_error(errno, std::generic_category(), "websocket send");
+                if (closed_)
+                    break;
+            }
+            out_.clear();
+        }
+
+        int fd_ = -1;
+        detail::ws_frame_parser frames_;
+        std::unique_ptr<char[]> buffer_;
+        std::string out_;
+        std::mt19937 rng_;
+        bool close_sent_ = false;
+        bool closed_ = false;
+        bool needs_poll_;
+        endpoint ep_;
+    };
+
+} // namespace pooriayousefi
@@ -26,6 +26,7 @@ int run_jsonrpc_fundamentals();
 int run_calculator_service();
 int run_database_service();
 int run_advanced_features();
+int run_transport_tests();
 void run_serialization_tests(); // New serialization tests
 
 struct Tutorial
@@ -83,7 +84,8 @@ int main()
             {"Tutorial 3: JSON-RPC Fundamentals", run_jsonrpc_fundamentals},
             {"Tutorial 4: Calculator Service", run_calculator_service},
             {"Tutorial 5: Database/CRUD Service", run_database_service},
-            {"Tutorial 6: Advanced Features", run_advanced_features}};
+            {"Tutorial 6: Advanced Features", run_advanced_features},
+            {"Tutorial 7: Transport Tests", run_transport_tests}};
 
         int total_passed = 0;
         int total_failed = 0;
@@ -118,7 +120,7 @@ int main()
             std::cout << COLOR_GREEN << "All tutorials completed successfully! ✓" << COLOR_RESET
                       << "\n\n";
             std::cout << "Summary:\n";
-            std::cout << "  - 6 tutorials compiled and executed\n";
+            std::cout << "  - 7 tutorials compiled and executed\n";
             std::cout << "  - 12 serialization/deserialization tests passed\n";
             std::cout << "  - All tests passed\n";
             std::cout << "  - Library is working correctly\n\n";
@@ -332,6 +332,32 @@ void run_calculator_demo(CalculatorService &calc)
     }
 }
 
+// ============================================================================
+// Compile-Time Routing
+// ============================================================================
+
+// Stateless operations can be bound at compile time; routing and calls are generated by the
+// compiler instead of going through std::function.
+static double static_add(std::vector<double> v) { return v.at(0) + v.at(1); }
+static double static_multiply(std::vector<double> v) { return v.at(0) * v.at(1); }
+static double static_pi() { return M_PI; }
+
+using static_calculator = static_dispatcher<method<"add", &static_add>,
+                                            method<"multiply", &static_multiply>,
+                                            method<"pi", &static_pi>>;
+
+void run_static_calculator_demo()
+{
+    std::cout << "7. Compile-Time Routing (static_dispatcher):\n";
+    static_calculator calc;
+    json batch = json::array({make_request(14, "add", json::array({1.5, 2.5})),
+                              make_request(15, "multiply", json::array({6, 7})),
+                              make_request(16, "pi")});
+    std::cout << "  Batch Request: " << batch.dump() << "\n";
+    auto resp = calc.handle(batch);
+    std::cout << "  Batch Response: " << resp->dump() << "\n\n";
+}
+
 // ============================================================================
 // Main Entry Point
 // ============================================================================
@@ -342,6 +368,7 @@ int run_calculator_service()
     {
         CalculatorService calc;
         run_calculator_demo(calc);
+        run_static_calculator_demo();
 
         std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n";
         std::cout << "Calculator service completed successfully!\n";
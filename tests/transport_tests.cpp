@@ -0,0 +1,1418 @@
+/*
+ * JSON-RPC 2.0 Library - Transport Tests
+ *
+ * Tests for the transports: message framing, the TCP and HTTP servers, stdio, shared memory,
+ * the in-process channel and Unix domain sockets.
+ */
+
+#include "../include/jsonrpc_http.hpp"
+#include "../include/jsonrpc_inproc.hpp"
+#include "../include/jsonrpc_shm.hpp"
+#include "../include/jsonrpc_stdio.hpp"
+#include "../include/jsonrpc_tcp.hpp"
+#include "../include/jsonrpc_unix.hpp"
+#include "../include/jsonrpc_websocket.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace pooriayousefi;
+using json = nlohmann::json;
+
+#define ASSERT(expr)                                                                               \
+    do                                                                                             \
+    {                                                                                              \
+        if (!(expr))                                                                               \
+        {                                                                                          \
+            std::cerr << "  ✗ Assertion failed: " << #expr << " at " << __FILE__ << ":"            \
+                      << __LINE__ << std::endl;                                                    \
+            return false;                                                                          \
+        }                                                                                          \
+    } while (0)
+
+#define TEST(name)                                                                                 \
+    static bool test_##name();                                                                     \
+    static bool test_##name()
+
+#define RUN_TEST(name)                                                                             \
+    do                                                                                             \
+    {                                                                                              \
+        std::cout << "  Running: " << #name << "...";                                              \
+        if (test_##name())                                                                         \
+        {                                                                                          \
+            std::cout << " ✓" << std::endl;                                                        \
+            passed++;                                                                              \
+        }                                                                                          \
+        else                                                                                       \
+        {                                                                                          \
+            std::cout << " ✗" << std::endl;                                                        \
+            failed++;                                                                              \
+        }                                                                                          \
+    } while (0)
+
+// Blocking loopback client, enough to talk NDJSON to a server
+class test_client
+{
+  public:
+    // receive_buffer: SO_RCVBUF to ask for (0: the kernel's default)
+    explicit test_client(std::uint16_t port, int receive_buffer = 0)
+        : fd_(::socket(AF_INET, SOCK_STREAM, 0))
+    {
+        timeval tv{5, 0}; // never hang the suite
+        ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        if (receive_buffer > 0)
+            ::setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        connected_ = ::connect(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+    }
+    ~test_client() { close(); }
+
+    bool connected() const { return connected_; }
+
+    void close()
+    {
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+    }
+
+    bool send(std::string_view data)
+    {
+        while (!data.empty())
+        {
+            ssize_t n = ::send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data.remove_prefix(static_cast<std::size_t>(n));
+        }
+        return true;
+    }
+
+    // Whatever has arrived (waiting for at least a byte); 0 on timeout/EOF
+    std::size_t receive(char *dst, std::size_t size)
+    {
+        for (;;)
+        {
+            ssize_t n = ::recv(fd_, dst, size, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            return n > 0 ? static_cast<std::size_t>(n) : 0;
+        }
+    }
+
+    // Next newline-terminated message, or null on timeout/EOF
+    json read_message()
+    {
+        for (;;)
+        {
+            auto nl = buffer_.find('\n');
+            if (nl != std::string::npos)
+            {
+                auto msg = json::parse(buffer_.substr(0, nl));
+                buffer_.erase(0, nl + 1);
+                return msg;
+            }
+            char chunk[4096];
+            ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return nullptr;
+            buffer_.append(chunk, static_cast<std::size_t>(n));
+        }
+    }
+
+  private:
+    int fd_;
+    bool connected_ = false;
+    std::string buffer_;
+};
+
+static void add_echo(endpoint &ep)
+{
+    ep.add("echo", [](const json &params) { return params; });
+    ep.add("add", [](const json &params) { return params[0].get<int>() + params[1].get<int>(); });
+}
+
+// Backends to exercise: epoll always, io_uring where the kernel has it
+static std::vector<tcp_backend> available_backends()
+{
+    std::vector<tcp_backend> backends{tcp_backend::epoll};
+    if (tcp_server({}, add_echo).backend() == tcp_backend::io_uring)
+        backends.push_back(tcp_backend::io_uring);
+    return backends;
+}
+
+// ============================================================================
+// Framing Tests
+// ============================================================================
+
+TEST(ndjson_codec_framing)
+{
+    ndjson_codec codec(32);
+    std::vector<std::string> out;
+    auto collect = [&](std::string_view m) { out.emplace_back(m); };
+
+    // Whole lines, a CRLF line and blank lines in one chunk
+    ASSERT(codec.decode("{\"a\":1}\n\n{\"b\":2}\r\n", collect));
+    ASSERT(out.size() == 2 && out[0] == "{\"a\":1}" && out[1] == "{\"b\":2}");
+
+    // A message split across three reads
+    out.clear();
+    ASSERT(codec.decode("{\"c\"", collect));
+    ASSERT(codec.decode(":3", collect));
+    ASSERT(out.empty());
+    ASSERT(codec.decode("}\n{\"d\":4}\n", collect));
+    ASSERT(out.size() == 2 && out[0] == "{\"c\":3}" && out[1] == "{\"d\":4}");
+
+    // Encoding appends exactly one line
+    std::string buf;
+    codec.encode(json{{"x", 1}}, buf);
+    codec.encode(json{{"y", 2}}, buf);
+    ASSERT(buf == "{\"x\":1}\n{\"y\":2}\n");
+
+    // An unterminated message beyond the limit is a framing error
+    ASSERT(!codec.decode(std::string(64, 'x'), collect));
+    return true;
+}
+
+TEST(ndjson_newline_scan)
+{
+    // Every kernel this build has must agree with a byte loop, at any length and alignment,
+    // including bytes that differ from '\n' only in the high bit
+    std::vector<detail::newline_kernel> kernels{detail::scan_newlines_scalar,
+                                                detail::newline_scanner()};
+#ifdef JSONRPC_X86_SIMD
+    kernels.push_back(detail::scan_newlines_sse2);
+    if (__builtin_cpu_supports("avx2"))
+        kernels.push_back(detail::scan_newlines_avx2);
+#endif
+    const char alphabet[] = {'\n', 'a', '\r', char(0x8a), char(0x0b), char(0x09), '{'};
+    std::string data(detail::newline_window + 64, 'x');
+    unsigned seed = 7;
+    for (auto &c : data)
+    {
+        seed = seed * 1103515245 + 12345;
+        c = alphabet[(seed >> 16) % sizeof(alphabet)];
+    }
+    std::vector<std::uint16_t> expected(detail::newline_window), got(detail::newline_window);
+    for (std::size_t offset = 0; offset < 64; offset += 7)
+    {
+        for (std::size_t n : {0, 1, 7, 8, 15, 16, 31, 33, 63, 64, 65, 200, 4096})
+        {
+            const char *p = data.data() + offset;
+            std::size_t want = 0;
+            for (std::size_t i = 0; i < n; ++i)
+                if (p[i] == '\n')
+                    expected[want++] = static_cast<std::uint16_t>(i);
+            for (auto kernel : kernels)
+            {
+                ASSERT(kernel(p, n, got.data()) == want);
+                ASSERT(std::equal(expected.begin(), expected.begin() + want, got.begin()));
+            }
+        }
+    }
+
+    // A dense stream decodes the same whatever the read size
+    std::string stream;
+    for (int i = 0; i < 2000; ++i)
+        stream += std::to_string(i) + (i % 3 ? "\n" : "\r\n\n");
+    for (std::size_t chunk : {1, 3, 64, 1000, 5000, 100000})
+    {
+        ndjson_codec codec;
+        int next = 0;
+        bool in_order = true;
+        for (std::size_t at = 0; at < stream.size(); at += chunk)
+        {
+            codec.decode(std::string_view(stream).substr(at, chunk),
+                         [&](std::string_view m) { in_order &= m == std::to_string(next++); });
+        }
+        ASSERT(in_order && next == 2000);
+    }
+    return true;
+}
+
+TEST(content_length_codec_framing)
+{
+    content_length_codec codec(1024);
+    std::vector<std::string> out;
+    auto collect = [&](std::string_view m) { out.emplace_back(m); };
+
+    // Two messages in one read, with another header and odd casing
+    std::string wire = "Content-Length: 7\r\n\r\n{\"a\":1}"
+                       "content-length:7\r\nContent-Type: application/vscode-jsonrpc\r\n\r\n"
+                       "{\"b\":2}";
+    ASSERT(codec.decode(wire, collect));
+    ASSERT(out.size() == 2 && out[0] == "{\"a\":1}" && out[1] == "{\"b\":2}");
+
+    // The same bytes one at a time: headers and bodies split everywhere
+    out.clear();
+    for (char c : wire)
+        ASSERT(codec.decode(std::string_view(&c, 1), collect));
+    ASSERT(out.size() == 2 && out[0] == "{\"a\":1}" && out[1] == "{\"b\":2}");
+    ASSERT(codec.idle());
+
+    // Encoding round-trips
+    std::string buf;
+    codec.encode(json{{"x", "y"}}, buf);
+    ASSERT(buf == "Content-Length: 9\r\n\r\n{\"x\":\"y\"}");
+
+    // Bodies can be filled in place
+    out.clear();
+    ASSERT(codec.decode("Content-Length: 5\r\n\r\n12", collect));
+    auto [dst, room] = codec.body_space();
+    ASSERT(room == 3);
+    std::memcpy(dst, "345", 3);
+    codec.body_written(3, collect);
+    ASSERT(out.size() == 1 && out[0] == "12345");
+
+    // Missing or oversized lengths are framing errors
+    ASSERT(!content_length_codec().decode("Content-Type: x\r\n\r\n", collect));
+    ASSERT(!content_length_codec().decode("Content-Length: 1x\r\n\r\n", collect));
+    ASSERT(!codec.decode("Content-Length: 4096\r\n\r\n", collect));
+    return true;
+}
+
+TEST(http_parser_framing)
+{
+    struct message
+    {
+        bool post;
+        bool keep_alive;
+        std::string body;
+    };
+    std::vector<message> out;
+    auto collect = [&](const detail::http_head &h, std::string_view body)
+    { out.push_back({h.post, h.keep_alive, std::string(body)}); };
+
+    // Pipelined: a sized body, a chunked one (extension, trailer), HTTP/1.0, a GET
+    std::string wire = "POST /rpc HTTP/1.1\r\nHost: x\r\ncontent-length: 7\r\n\r\n{\"a\":1}"
+                       "POST /rpc HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                       "3;ext=1\r\n{\"b\r\n4\r\n\":2}\r\n0\r\nX-Trailer: t\r\n\r\n"
+                       "POST / HTTP/1.0\r\nContent-Length: 2\r\n\r\n[]"
+                       "GET / HTTP/1.1\r\nConnection: close\r\n\r\n";
+    auto check = [&]
+    {
+        return out.size() == 4 && out[0].post && out[0].body == "{\"a\":1}" &&
+               out[1].body == "{\"b\":2}" && out[1].keep_alive && !out[2].keep_alive &&
+               out[2].body == "[]" && !out[3].post && !out[3].keep_alive && out[3].body.empty();
+    };
+    detail::http_parser whole(true, 1024);
+    ASSERT(whole.feed(wire, collect) && check() && whole.idle());
+
+    // The same bytes one at a time
+    out.clear();
+    detail::http_parser split(true, 1024);
+    for (char c : wire)
+        ASSERT(split.feed(std::string_view(&c, 1), collect));
+    ASSERT(check() && split.idle());
+
+    // Responses: interim 100 skipped, 204 without a body, zero-padded chunk sizes
+    std::vector<int> statuses;
+    out.clear();
+    detail::http_parser responses(false, 1024);
+    ASSERT(responses.feed("HTTP/1.1 100 Continue\r\n\r\n"
+                          "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n"
+                          "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                          "00000002\r\nok\r\n0\r\n\r\n",
+                          [&](const detail::http_head &h, std::string_view body)
+                          {
+                              statuses.push_back(h.status);
+                              out.push_back({false, h.keep_alive, std::string(body)});
+                          }));
+    ASSERT(statuses == std::vector<int>({204, 200}) && out[1].body == "ok");
+
+    // Malformed or oversized
+    auto ignore = [](const detail::http_head &, std::string_view) {};
+    ASSERT(!detail::http_parser(true, 1024).feed("POST / SPDY/3\r\n\r\n", ignore));
+    ASSERT(!detail::http_parser(true, 1024).feed("POST / HTTP/1.1\r\nContent-Length: x\r\n\r\n",
+                                                 ignore));
+    ASSERT(!detail::http_parser(true, 1024).feed("POST / HTTP/1.1\r\nContent-Length: 2000\r\n\r\n",
+                                                 ignore));
+    ASSERT(!detail::http_parser(true, 1024).feed(
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", ignore));
+    ASSERT(!detail::http_parser(true, 1024).feed(std::string(16 * 1024, 'h'), ignore));
+    return true;
+}
+
+TEST(websocket_framing)
+{
+    // Handshake primitives against the FIPS 180 and RFC 6455 vectors
+    auto digest = detail::sha1("abc");
+    ASSERT(detail::base64_encode(digest.data(), digest.size()) == "qZk+NkcGgWq6PiVxeFDCbJzQ2J0=");
+    ASSERT(detail::websocket_accept("dGhlIHNhbXBsZSBub25jZQ==") == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+    std::string million(1000000, 'a');
+    digest = detail::sha1(million);
+    ASSERT(detail::base64_encode(digest.data(), digest.size()) == "NKqXPNTE2qT2Husr260nMWU0AW8=");
+
+    // Every unmask kernel agrees with a byte-wise reference at all lengths and phases
+    std::vector<detail::unmask_kernel> kernels{detail::unmask_scalar};
+#ifdef JSONRPC_X86_SIMD
+    kernels.push_back(detail::unmask_sse2);
+    if (__builtin_cpu_supports("avx2"))
+        kernels.push_back(detail::unmask_avx2);
+#endif
+    const unsigned char key[4] = {0x37, 0xfa, 0x21, 0x3d};
+    std::uint32_t key_word;
+    std::memcpy(&key_word, key, 4);
+    std::string source(300, '\0');
+    for (std::size_t i = 0; i < source.size(); ++i)
+        source[i] = static_cast<char>(i * 7 + 3);
+    for (auto kernel : kernels)
+        for (std::size_t phase = 0; phase < 4; ++phase)
+            for (std::size_t n = 0; n < 200; ++n)
+            {
+                std::string out(n, '\0');
+                kernel(out.data(), source.data() + 1, n, detail::rotate_mask(key_word, phase));
+                for (std::size_t i = 0; i < n; ++i)
+                    ASSERT(out[i] == static_cast<char>(source[1 + i] ^ key[(phase + i) & 3]));
+            }
+
+    // Writer and parser round trip, masked and not, for one, two-byte-length and
+    // fragmented payloads
+    std::mt19937 rng(7);
+    for (std::size_t size : {10, 200, 40000})
+        for (bool masked : {false, true})
+        {
+            json msg = {{"jsonrpc", "2.0"}, {"result", std::string(size, 'w')}, {"id", 1}};
+            std::string wire;
+            detail::ws_write_message(msg, wire, masked ? &rng : nullptr);
+            std::vector<std::string> messages;
+            detail::ws_frame_parser parser(masked, 1 << 20);
+            ASSERT(parser.feed(
+                wire, [&](std::string_view text) { messages.emplace_back(text); },
+                [](std::uint8_t, std::string_view) {}));
+            ASSERT(messages.size() == 1 && messages[0] == msg.dump());
+        }
+
+    // A fragmented masked message with a ping between its fragments, fed byte by byte
+    json big = {{"jsonrpc", "2.0"}, {"method", "echo"}, {"params", {std::string(20000, 'p')}}};
+    std::string wire;
+    detail::ws_write_message(big, wire, &rng);
+    std::string ping;
+    detail::ws_write_control(detail::ws_ping, "hi", ping, &rng);
+    ASSERT((wire[0] & 0x80) == 0 && wire[0] == detail::ws_text);
+    wire.insert(8 + detail::ws_fragment_output::fragment_size, ping);
+    std::vector<std::string> messages;
+    std::vector<std::string> pings;
+    detail::ws_frame_parser parser(true, 1 << 20);
+    auto on_message = [&](std::string_view text) { messages.emplace_back(text); };
+    auto on_control = [&](std::uint8_t opcode, std::string_view payload)
+    {
+        if (opcode == detail::ws_ping)
+            pings.emplace_back(payload);
+    };
+    for (char c : wire)
+        ASSERT(parser.feed(std::string_view(&c, 1), on_message, on_control));
+    ASSERT(pings == std::vector<std::string>{"hi"});
+    ASSERT(messages.size() == 1 && json::parse(messages[0]) == big);
+
+    // Frames behind a close frame are not parsed, in the same read or a later one
+    wire.clear();
+    detail::ws_write_control(detail::ws_close, "", wire, &rng);
+    detail::ws_write_message(big, wire, &rng);
+    messages.clear();
+    detail::ws_frame_parser closing(true, 1 << 20);
+    ASSERT(closing.feed(wire, on_message, on_control));
+    ASSERT(closing.feed(wire, on_message, on_control));
+    ASSERT(messages.empty());
+    // ... so the server runs no handler for them
+    websocket_codec codec;
+    std::string out;
+    codec.attach(out);
+    std::string upgrade = "GET / HTTP/1.1\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\n"
+                          "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    ASSERT(!codec.decode(upgrade + wire, on_message));
+    ASSERT(messages.empty());
+
+    // Protocol violations: unmasked from a client, RSV bits, a fragmented control frame,
+    // a continuation with no message, a message over the limit
+    auto none = [](std::string_view) {};
+    auto controls = [](std::uint8_t, std::string_view) {};
+    ASSERT(!detail::ws_frame_parser(true, 1024).feed("\x81\x02hi", none, controls));
+    ASSERT(!detail::ws_frame_parser(false, 1024).feed("\xc1\x02hi", none, controls));
+    ASSERT(!detail::ws_frame_parser(false, 1024).feed("\x09\x02hi", none, controls));
+    ASSERT(!detail::ws_frame_parser(false, 1024).feed("\x80\x02hi", none, controls));
+    ASSERT(!detail::ws_frame_parser(false, 100).feed("\x81\x7e\x01\x01", none, controls));
+    return true;
+}
+
+// ============================================================================
+// TCP Server Tests
+// ============================================================================
+
+static bool round_trip(tcp_backend backend)
+{
+    tcp_server_options options;
+    options.backend = backend;
+    tcp_server server(options, add_echo);
+    ASSERT(server.backend() == backend);
+    server.start();
+    ASSERT(server.port() != 0);
+
+    test_client client(server.port());
+    ASSERT(client.connected());
+
+    // Pipelined requests, a notification and garbage, in one write
+    ASSERT(client.send(R"({"jsonrpc":"2.0","method":"add","params":[2,3],"id":1})"
+                       "\n"
+                       R"({"jsonrpc":"2.0","method":"echo","params":["hi"]})"
+                       "\n"
+                       "not json\n"
+                       R"({"jsonrpc":"2.0","method":"echo","params":{"k":"v"},"id":"s"})"
+                       "\n"));
+
+    auto r1 = client.read_message();
+    ASSERT(r1["id"] == 1 && r1["result"] == 5);
+    auto r2 = client.read_message();
+    ASSERT(r2["id"].is_null() && r2["error"]["code"] == -32700);
+    auto r3 = client.read_message();
+    ASSERT(r3["id"] == "s" && r3["result"]["k"] == "v");
+
+    // A message split across writes
+    ASSERT(client.send(R"({"jsonrpc":"2.0","method":"add",)"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    ASSERT(client.send(R"("params":[40,2],"id":2})"
+                       "\n"));
+    auto r4 = client.read_message();
+    ASSERT(r4["id"] == 2 && r4["result"] == 42);
+
+    // A response larger than one send
+    std::string big(1 << 20, 'x');
+    ASSERT(client.send(json{{"jsonrpc", "2.0"}, {"method", "echo"}, {"params", {big}}, {"id", 3}}
+                           .dump() +
+                       "\n"));
+    auto r5 = client.read_message();
+    ASSERT(r5["id"] == 3 && r5["result"][0] == big);
+    return true;
+}
+
+TEST(tcp_server_round_trip)
+{
+    for (auto backend : available_backends())
+        ASSERT(round_trip(backend));
+    return true;
+}
+
+static bool reactors(tcp_backend backend)
+{
+    tcp_server_options options;
+    options.reactors = 3;
+    options.backend = backend;
+    tcp_server server(options, add_echo);
+    server.start();
+
+    // Every connection gets its own endpoint, whichever reactor it lands on
+    std::vector<std::unique_ptr<test_client>> clients;
+    for (int i = 0; i < 8; ++i)
+    {
+        clients.push_back(std::make_unique<test_client>(server.port()));
+        ASSERT(clients.back()->connected());
+    }
+    for (int round = 0; round < 3; ++round)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            json req = {{"jsonrpc", "2.0"}, {"method", "add"}, {"params", {i, round}}, {"id", i}};
+            ASSERT(clients[i]->send(req.dump() + "\n"));
+        }
+        for (int i = 0; i < 8; ++i)
+        {
+            auto r = clients[i]->read_message();
+            ASSERT(r["id"] == i && r["result"] == i + round);
+        }
+    }
+    ASSERT(server.connection_count() == 8);
+
+    // Closed peers are dropped
+    for (int i = 0; i < 4; ++i)
+        clients[i]->close();
+    for (int spin = 0; spin < 500 && server.connection_count() != 4; ++spin)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ASSERT(server.connection_count() == 4);
+
+    // Stopping with connections still open
+    server.stop();
+    ASSERT(server.connection_count() == 0);
+    return true;
+}
+
+TEST(tcp_server_reactors)
+{
+    for (auto backend : available_backends())
+        ASSERT(reactors(backend));
+    return true;
+}
+
+static bool timeouts_and_batching(tcp_backend backend)
+{
+    // Outgoing requests from the server side are flushed and timed out by the reactor
+    tcp_server_options options;
+    options.backend = backend;
+    options.endpoint.batching = true;
+    options.endpoint.default_timeout = std::chrono::milliseconds(20);
+    std::atomic<int> timed_out{0};
+    tcp_server server(options,
+                      [&](endpoint &ep)
+                      {
+                          ep.add("ask",
+                                 [&ep, &timed_out](const json &)
+                                 {
+                                     ep.send_request(
+                                         "question", nullptr, [](const json &) {},
+                                         [&timed_out](const json &err)
+                                         {
+                                             if (err["code"] == -32001)
+                                                 timed_out++;
+                                         });
+                                     return "asked";
+                                 });
+                      });
+    server.start();
+
+    test_client client(server.port());
+    ASSERT(client.send(R"({"jsonrpc":"2.0","method":"ask","id":1})"
+                       "\n"));
+    // Both the response and the server's own request arrive, in either order
+    json first = client.read_message();
+    json second = client.read_message();
+    ASSERT(!first.is_null() && !second.is_null());
+    json &question = first.contains("method") ? first : second;
+    json &answer = first.contains("method") ? second : first;
+    ASSERT(question["method"] == "question" && answer["result"] == "asked");
+
+    for (int spin = 0; spin < 500 && timed_out.load() == 0; ++spin)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ASSERT(timed_out.load() == 1);
+    return true;
+}
+
+TEST(tcp_server_timeouts_and_batching)
+{
+    for (auto backend : available_backends())
+        ASSERT(timeouts_and_batching(backend));
+    return true;
+}
+
+// A peer that pipelines requests without reading stops being read (epoll)
+TEST(tcp_server_backpressure)
+{
+    for (auto backend : available_backends())
+    {
+        tcp_server_options options;
+        options.backend = backend;
+        options.max_pending_output = 64 * 1024;
+        std::atomic<int> handled{0};
+        const std::string big(16 * 1024, 'b');
+        tcp_server server(options,
+                          [&](endpoint &ep)
+                          {
+                              ep.add("big", [&](const json &) -> json
+                                     {
+                                         ++handled;
+                                         return big;
+                                     });
+                          });
+        server.start();
+        test_client client(server.port(), 32 * 1024);
+        ASSERT(client.connected());
+
+        // 2000 x 16 KiB of responses: far more than the socket buffers hold
+        const int count = 2000;
+        std::string requests;
+        for (int i = 0; i < count; ++i)
+            requests += R"({"jsonrpc":"2.0","method":"big","id":)" + std::to_string(i) + "}\n";
+        ASSERT(client.send(requests));
+        // Wait for the server to stall (or, without backpressure, to handle everything)
+        for (int seen = -1; seen != handled.load() && handled.load() < count;)
+        {
+            seen = handled.load();
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        ASSERT(handled.load() < count);
+
+        // Reading lets the server catch up and answer everything, in order
+        for (int i = 0; i < count; ++i)
+        {
+            auto r = client.read_message();
+            ASSERT(r["id"] == i && r["result"] == big);
+        }
+        ASSERT(handled.load() == count);
+    }
+    return true;
+}
+
+// ============================================================================
+// HTTP Transport Tests
+// ============================================================================
+
+// Awaitable that parks the coroutine until the test resumes it
+struct parked
+{
+    std::vector<std::coroutine_handle<>> *queue;
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> h) const { queue->push_back(h); }
+    void await_resume() const {}
+};
+
+// The codec on its own: response order with async handlers, Connection: close and HTTP/1.0
+TEST(http_codec_exchanges)
+{
+    std::vector<std::coroutine_handle<>> queue;
+    auto resume_all = [&queue]
+    {
+        auto ready = std::move(queue);
+        queue.clear();
+        for (auto h : ready)
+            h.resume();
+    };
+    auto request = [](std::string_view version, std::string_view headers, std::string_view body)
+    {
+        return "POST / HTTP/" + std::string(version) + "\r\n" + std::string(headers) +
+               "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" +
+               std::string(body);
+    };
+    struct reply
+    {
+        detail::http_head head;
+        std::string body;
+    };
+    auto replies = [](std::string &out)
+    {
+        std::vector<reply> got;
+        detail::http_parser parser(false, 1 << 20);
+        parser.feed(out, [&](const detail::http_head &h, std::string_view body)
+                    { got.push_back({h, std::string(body)}); });
+        out.clear();
+        return got;
+    };
+
+    struct connection
+    {
+        explicit connection(std::vector<std::coroutine_handle<>> &queue)
+            : ep([this](const json &msg) { codec.encode(msg, out); })
+        {
+            codec.attach(out);
+            ep.set_response_sender([this](const response_parts &r) { codec.encode(r, out); });
+            add_echo(ep);
+            ep.add_async("later",
+                         [&queue](const json &params) -> task<json>
+                         {
+                             co_await parked{&queue};
+                             co_return params;
+                         });
+        }
+        bool feed(const std::string &bytes)
+        {
+            return codec.decode(bytes, [this](std::string_view m) { ep.receive_raw(m); });
+        }
+        http_codec codec;
+        std::string out;
+        endpoint ep;
+    };
+
+    // A request answered later keeps its place; the ones behind it wait for it
+    connection c(queue);
+    const std::string mixed_batch = R"([{"jsonrpc":"2.0","method":"later","params":[3],"id":3},)"
+                                    R"({"jsonrpc":"2.0","method":"add","params":[2,2],"id":4}])";
+    ASSERT(c.feed(request("1.1", "", R"({"jsonrpc":"2.0","method":"later","params":[1],"id":1})") +
+                  request("1.1", "", R"({"jsonrpc":"2.0","method":"add","params":[1,1],"id":2})") +
+                  request("1.1", "", R"({"jsonrpc":"2.0","method":"echo","params":[0]})") +
+                  request("1.1", "", mixed_batch)));
+    ASSERT(c.out.empty());
+    ASSERT(c.codec.pending_output() > 0); // counted against the server's output limit
+    resume_all();
+    ASSERT(c.codec.pending_output() == 0);
+    auto got = replies(c.out);
+    ASSERT(got.size() == 4);
+    ASSERT(got[0].head.status == 200 && json::parse(got[0].body)["id"] == 1);
+    ASSERT(got[1].head.status == 200 && json::parse(got[1].body)["result"] == 2);
+    ASSERT(got[2].head.status == 204);
+    auto batch = json::parse(got[3].body);
+    ASSERT(got[3].head.chunked && batch.size() == 2 && batch[0]["result"] == 4);
+
+    // Connection: close is answered, then nothing else is read and decode asks to close
+    connection closing(queue);
+    ASSERT(!closing.feed(
+        request("1.1", "Connection: close\r\n",
+                R"({"jsonrpc":"2.0","method":"add","params":[2,3],"id":1})") +
+        request("1.1", "", R"({"jsonrpc":"2.0","method":"add","params":[0,0],"id":2})")));
+    got = replies(closing.out);
+    ASSERT(got.size() == 1 && !got[0].head.keep_alive && json::parse(got[0].body)["id"] == 1);
+
+    // ... also when its response comes late
+    connection late(queue);
+    ASSERT(late.feed(request("1.1", "Connection: close\r\n",
+                             R"({"jsonrpc":"2.0","method":"later","params":[],"id":1})")));
+    ASSERT(!late.codec.finished());
+    resume_all();
+    ASSERT(late.codec.finished() && replies(late.out).size() == 1);
+
+    // HTTP/1.0 peers get no chunked bodies, and the connection closes unless kept alive
+    connection old(queue);
+    const std::string old_batch = R"([{"jsonrpc":"2.0","method":"add","params":[1,2],"id":1}])";
+    ASSERT(old.feed(request("1.0", "Connection: keep-alive\r\n", old_batch)));
+    ASSERT(!old.feed(request("1.0", "", old_batch)));
+    got = replies(old.out);
+    ASSERT(got.size() == 2 && !got[0].head.chunked && !got[1].head.chunked);
+    ASSERT(got[0].head.keep_alive && !got[1].head.keep_alive);
+    ASSERT(json::parse(got[1].body)[0]["result"] == 3);
+    return true;
+}
+
+// Raw pipelined exchange: status codes, keep-alive and chunked batch responses
+static bool http_raw(tcp_backend backend)
+{
+    tcp_server_options options;
+    options.backend = backend;
+    http_server server(options, add_echo);
+    server.start();
+    test_client client(server.port());
+    ASSERT(client.connected());
+
+    auto post = [](std::string_view body)
+    {
+        return "POST /rpc HTTP/1.1\r\nHost: localhost\r\nContent-Length: " +
+               std::to_string(body.size()) + "\r\n\r\n" + std::string(body);
+    };
+    ASSERT(client.send(post(R"({"jsonrpc":"2.0","method":"add","params":[2,3],"id":1})") +
+                       post(R"({"jsonrpc":"2.0","method":"echo","params":[1]})") +
+                       "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n" +
+                       post(R"([{"jsonrpc":"2.0","method":"add","params":[1,1],"id":2},)"
+                            R"({"jsonrpc":"2.0","method":"add","params":[2,2],"id":3}])")));
+
+    std::vector<std::pair<int, std::string>> replies;
+    std::vector<bool> chunked;
+    detail::http_parser parser(false, 1 << 20);
+    char buffer[4096];
+    while (replies.size() < 4)
+    {
+        std::size_t n = client.receive(buffer, sizeof(buffer));
+        ASSERT(n > 0);
+        ASSERT(parser.feed(std::string_view(buffer, n),
+                           [&](const detail::http_head &h, std::string_view body)
+                           {
+                               replies.emplace_back(h.status, std::string(body));
+                               chunked.push_back(h.chunked);
+                           }));
+    }
+    ASSERT(replies[0].first == 200 && json::parse(replies[0].second)["result"] == 5);
+    ASSERT(replies[1].first == 204 && replies[2].first == 405);
+    auto batch = json::parse(replies[3].second);
+    ASSERT(replies[3].first == 200 && chunked[3] && batch.size() == 2);
+    ASSERT(batch[0]["result"] == 2 && batch[1]["result"] == 4);
+
+    // Connection: close is answered and then the server closes the connection
+    ASSERT(client.send("POST /rpc HTTP/1.1\r\nConnection: close\r\nContent-Length: 2\r\n\r\n[]"));
+    bool keep_alive = true;
+    auto sent_at = std::chrono::steady_clock::now();
+    for (std::size_t n = 1; n > 0;)
+    {
+        n = client.receive(buffer, sizeof(buffer));
+        ASSERT(parser.feed(std::string_view(buffer, n),
+                           [&](const detail::http_head &h, std::string_view body)
+                           {
+                               replies.emplace_back(h.status, std::string(body));
+                               keep_alive = h.keep_alive;
+                           }));
+    }
+    ASSERT(std::chrono::steady_clock::now() - sent_at < std::chrono::seconds(4)); // not timeout
+    ASSERT(replies.size() == 5 && !keep_alive);
+    ASSERT(json::parse(replies[4].second)["error"]["code"] == -32600);
+    return true;
+}
+
+// The client: pipelined requests, then a batch whose response spans many chunks
+static bool http_client_server(tcp_backend backend)
+{
+    tcp_server_options options;
+    options.backend = backend;
+    http_server server(options, add_echo);
+    server.start();
+
+    http_client client("127.0.0.1", server.port(), "/rpc");
+    const int count = 500;
+    int correct = 0;
+    for (int i = 0; i < count; ++i)
+        client.ep().send_request(
+            "add", json::array({i, i}), [&, i](const json &r) { correct += r == 2 * i; },
+            [](const json &) {});
+    client.ep().send_notification("echo", json::array({"ignored"}));
+    client.wait_all();
+    ASSERT(correct == count);
+
+    endpoint_options batching;
+    batching.batching = true;
+    batching.batch_max_messages = 8;
+    http_client batched("127.0.0.1", server.port(), "/rpc", batching);
+    std::string big(40 * 1024, 'c');
+    int echoed = 0;
+    for (int i = 0; i < 8; ++i)
+        batched.ep().send_request(
+            "echo", json::array({big}), [&](const json &r) { echoed += r[0] == big; },
+            [](const json &) {});
+    batched.wait_all();
+    ASSERT(echoed == 8);
+    return true;
+}
+
+// Responses queued behind a slow request count against max_pending_output
+static bool http_held_backpressure(tcp_backend backend)
+{
+    tcp_server_options options;
+    options.backend = backend;
+    options.max_pending_output = 64 * 1024;
+    options.endpoint.default_timeout = std::chrono::seconds(30); // the reactor polls
+    std::vector<std::coroutine_handle<>> queue;                  // reactor thread only
+    std::atomic<int> handled{0};
+    const std::string big(16 * 1024, 'b');
+    http_server server(options,
+                       [&](endpoint &ep)
+                       {
+                           ep.add_async("hold",
+                                        [&queue](const json &) -> task<json>
+                                        {
+                                            co_await parked{&queue};
+                                            co_return "held";
+                                        });
+                           ep.add("release", [&queue](const json &) -> json
+                                  {
+                                      for (auto h : std::exchange(queue, {}))
+                                          h.resume();
+                                      return nullptr;
+                                  });
+                           ep.add("big", [&](const json &) -> json
+                                  {
+                                      ++handled;
+                                      return big;
+                                  });
+                       });
+    server.start();
+    auto post = [](std::string_view method, int id)
+    {
+        std::string body = R"({"jsonrpc":"2.0","method":")" + std::string(method) +
+                           R"(","id":)" + std::to_string(id) + "}";
+        return "POST / HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) +
+               "\r\n\r\n" + body;
+    };
+
+    // One request that is not answered yet, then far more than the limit behind it
+    test_client client(server.port(), 32 * 1024);
+    const int count = 1000;
+    std::string requests = post("hold", 0);
+    for (int i = 1; i <= count; ++i)
+        requests += post("big", i);
+    ASSERT(client.send(requests));
+    for (int seen = -1; seen != handled.load() && handled.load() < count;)
+    {
+        seen = handled.load();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    ASSERT(handled.load() < count);
+
+    // Answering the held request lets everything through, in order
+    test_client other(server.port());
+    ASSERT(other.send(post("release", 0)));
+    detail::http_parser parser(false, 1 << 20);
+    std::vector<json> ids;
+    char buffer[64 * 1024];
+    while (ids.size() < std::size_t(count) + 1)
+    {
+        std::size_t n = client.receive(buffer, sizeof(buffer));
+        ASSERT(n > 0);
+        ASSERT(parser.feed(std::string_view(buffer, n),
+                           [&](const detail::http_head &, std::string_view body)
+                           { ids.push_back(json::parse(body)["id"]); }));
+    }
+    for (int i = 0; i <= count; ++i)
+        ASSERT(ids[std::size_t(i)] == i);
+    ASSERT(handled.load() == count);
+    return true;
+}
+
+TEST(http_server_pipelining)
+{
+    for (auto backend : available_backends())
+        ASSERT(http_raw(backend) && http_client_server(backend) && http_held_backpressure(backend));
+    return true;
+}
+
+// A POST answered with an error status fails the requests it carried
+TEST(http_client_status_errors)
+{
+    // A server that answers three POSTs with 503, then waits for the client to hang up
+    int listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    ASSERT(::bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+    ASSERT(::listen(listener, 1) == 0);
+    ASSERT(::getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &length) == 0);
+    std::thread server(
+        [listener]
+        {
+            int fd = ::accept(listener, nullptr, nullptr);
+            std::string seen;
+            char buffer[4096];
+            auto posts = [&seen]
+            {
+                std::size_t n = 0;
+                for (auto at = seen.find("POST "); at != std::string::npos;
+                     at = seen.find("POST ", at + 1))
+                    ++n;
+                return n;
+            };
+            ssize_t n = 1;
+            while (posts() < 3 && (n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0)
+                seen.append(buffer, std::size_t(n));
+            std::string reply;
+            for (int i = 0; i < 3; ++i)
+                reply += "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+            ::send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+            while (::recv(fd, buffer, sizeof(buffer), 0) > 0)
+            {
+            }
+            ::close(fd);
+        });
+
+    std::vector<json> errors;
+    {
+        http_client client("127.0.0.1", ntohs(addr.sin_port));
+        auto on_error = [&errors](const json &e) { errors.push_back(e); };
+        client.ep().send_request("a", json::array(), [](const json &) {}, on_error);
+        client.ep().send_notification("n", json::array());
+        client.ep().send_request("b", json::array(), [](const json &) {}, on_error);
+        client.wait_all();
+    }
+    server.join();
+    ::close(listener);
+    ASSERT(errors.size() == 2);
+    for (const auto &e : errors)
+        ASSERT(e["code"] == http_status_error.code && e["data"]["status"] == 503);
+    return true;
+}
+
+// ============================================================================
+// WebSocket Transport Tests
+// ============================================================================
+
+// Raw handshake: a bad upgrade is refused, a good one answered with the accept key
+static bool websocket_raw(tcp_backend backend)
+{
+    tcp_server_options options;
+    options.backend = backend;
+    websocket_server server(options, add_echo);
+    server.start();
+
+    test_client refused(server.port());
+    ASSERT(refused.send("GET / HTTP/1.1\r\nHost: x\r\nUpgrade: websocket\r\n\r\n"));
+    char buffer[4096];
+    std::size_t n = refused.receive(buffer, sizeof(buffer));
+    ASSERT(std::string_view(buffer, n).starts_with("HTTP/1.1 400"));
+
+    // The first frame rides in the same write as the upgrade request
+    test_client client(server.port());
+    std::mt19937 rng(1);
+    std::string wire = "GET /rpc HTTP/1.1\r\nHost: x\r\nUpgrade: WebSocket\r\n"
+                       "Connection: keep-alive, Upgrade\r\n"
+                       "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                       "Sec-WebSocket-Version: 13\r\n\r\n";
+    json add = {{"jsonrpc", "2.0"}, {"method", "add"}, {"params", {1, 2}}, {"id", 1}};
+    detail::ws_write_message(add, wire, &rng);
+    detail::ws_write_control(detail::ws_ping, "p", wire, &rng);
+    ASSERT(client.send(wire));
+
+    std::string head;
+    detail::ws_frame_parser frames(false, 1 << 20);
+    std::vector<std::string> messages;
+    std::vector<std::uint8_t> controls;
+    auto on_message = [&](std::string_view text) { messages.emplace_back(text); };
+    auto on_control = [&](std::uint8_t opcode, std::string_view) { controls.push_back(opcode); };
+    while (messages.empty() || controls.empty())
+    {
+        n = client.receive(buffer, sizeof(buffer));
+        ASSERT(n > 0);
+        std::string_view bytes(buffer, n);
+        if (head.find("\r\n\r\n") == std::string::npos)
+        {
+            std::size_t old = head.size();
+            head.append(bytes);
+            std::size_t end = head.find("\r\n\r\n");
+            if (end == std::string::npos)
+                continue;
+            bytes.remove_prefix(end + 4 - old);
+        }
+        ASSERT(frames.feed(bytes, on_message, on_control));
+    }
+    ASSERT(head.starts_with("HTTP/1.1 101"));
+    ASSERT(head.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") != std::string::npos);
+    ASSERT(json::parse(messages[0])["result"] == 3 && controls[0] == detail::ws_pong);
+    return true;
+}
+
+// The client: pipelined requests, a message fragmented both ways, then the closing handshake
+static bool websocket_client_server(tcp_backend backend)
+{
+    tcp_server_options options;
+    options.backend = backend;
+    websocket_server server(options, add_echo);
+    server.start();
+
+    websocket_client client("127.0.0.1", server.port(), "/rpc");
+    const int count = 500;
+    int correct = 0;
+    int done = 0;
+    for (int i = 0; i < count; ++i)
+        client.ep().send_request(
+            "add", json::array({i, i}),
+            [&, i](const json &r)
+            {
+                correct += r == 2 * i;
+                ++done;
+            },
+            [](const json &) {});
+    client.ep().send_notification("echo", json::array({"ignored"}));
+    std::string big(100 * 1024, 'f');
+    bool echoed = false;
+    client.ep().send_request(
+        "echo", json::array({big}), [&](const json &r) { echoed = r[0] == big; },
+        [](const json &) {});
+    while (client.ep().pending_count() > 0)
+        ASSERT(client.wait(std::chrono::milliseconds(5000)) > 0);
+    ASSERT(correct == count && echoed);
+
+    client.close();
+    while (!client.closed())
+        client.wait(std::chrono::milliseconds(5000));
+    return true;
+}
+
+TEST(websocket_server_round_trip)
+{
+    for (auto backend : available_backends())
+        ASSERT(websocket_raw(backend) && websocket_client_server(backend));
+    return true;
+}
+
+// ============================================================================
+// Stdio Transport Tests
+// ============================================================================
+
+// Reads one Content-Length framed message from a blocking fd
+static json read_framed(int fd, std::string &buffer)
+{
+    for (;;)
+    {
+        auto end = buffer.find("\r\n\r\n");
+        if (end != std::string::npos)
+        {
+            std::size_t length = std::stoul(buffer.substr(buffer.find(':') + 1, end));
+            if (buffer.size() >= end + 4 + length)
+            {
+                auto msg = json::parse(buffer.substr(end + 4, length));
+                buffer.erase(0, end + 4 + length);
+                return msg;
+            }
+        }
+        char chunk[65536];
+        ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return nullptr;
+        buffer.append(chunk, static_cast<std::size_t>(n));
+    }
+}
+
+TEST(stdio_transport_pipes)
+{
+    int to_server[2];
+    int from_server[2];
+    ASSERT(::pipe(to_server) == 0 && ::pipe(from_server) == 0);
+
+    stdio_transport transport({}, to_server[0], from_server[1]);
+    add_echo(transport.ep());
+    bool clean = false;
+    std::thread server([&] { clean = transport.run(); });
+
+    std::string replies;
+    auto send_framed = [&](const json &msg)
+    {
+        std::string wire;
+        content_length_codec().encode(msg, wire);
+        return ::write(to_server[1], wire.data(), wire.size()) == ssize_t(wire.size());
+    };
+
+    ASSERT(send_framed({{"jsonrpc", "2.0"}, {"method", "add"}, {"params", {20, 22}}, {"id", 1}}));
+    auto r1 = read_framed(from_server[0], replies);
+    ASSERT(r1["id"] == 1 && r1["result"] == 42);
+
+    // Multi-megabyte message both ways (pipe capacity forces many partial reads/writes)
+    std::string big(3 * 1024 * 1024, 'z');
+    json request = {{"jsonrpc", "2.0"}, {"method", "echo"}, {"params", {big}}, {"id", 2}};
+    std::thread writer([&] { send_framed(request); });
+    auto r2 = read_framed(from_server[0], replies);
+    writer.join();
+    ASSERT(r2["id"] == 2 && r2["result"][0] == big);
+
+    // Closing the input ends run() cleanly
+    ::close(to_server[1]);
+    server.join();
+    ASSERT(clean);
+    ::close(to_server[0]);
+    ::close(from_server[0]);
+    ::close(from_server[1]);
+    return true;
+}
+
+TEST(shm_transport_round_trip)
+{
+    // A small ring so pipelined traffic wraps it many times and overflows into the backlog
+    shm_options server_options;
+    server_options.name = "/jsonrpc-test-" + std::to_string(::getpid());
+    server_options.create = true;
+    server_options.capacity = 64 * 1024;
+    shm_transport server(server_options);
+    add_echo(server.ep());
+    std::thread serving([&] { server.run(); });
+
+    shm_options client_options;
+    client_options.name = server_options.name;
+    shm_transport client(client_options);
+
+    const int count = 2000;
+    int correct = 0;
+    int errors = 0;
+    for (int i = 0; i < count; ++i)
+        client.ep().send_request(
+            "add", json::array({i, 1}), [&, i](const json &r) { correct += r == i + 1; },
+            [&](const json &) { ++errors; });
+    std::string big(48 * 1024, 'q');
+    json echoed;
+    client.ep().send_request(
+        "echo", json::array({big}), [&](const json &r) { echoed = r; },
+        [&](const json &) { ++errors; });
+    while (correct + errors < count || echoed.is_null())
+        client.wait(std::chrono::milliseconds(100));
+    ASSERT(correct == count && errors == 0);
+    ASSERT(echoed[0] == big && client.backlog() == 0);
+
+    // Larger than the ring can ever hold
+    bool rejected = false;
+    try
+    {
+        client.ep().send_notification("echo", json::array({std::string(64 * 1024, 'x')}));
+    }
+    catch (const std::system_error &e)
+    {
+        rejected = e.code().value() == EMSGSIZE;
+    }
+    ASSERT(rejected);
+
+    // Closing the client ends the server's run()
+    client.close();
+    serving.join();
+    ASSERT(server.peer_closed());
+    return true;
+}
+
+TEST(inproc_channel_pump)
+{
+    inproc_channel channel;
+    add_echo(channel.b().ep());
+    // Messages are moved end to end: the client sees the very string the handler returned
+    const char *returned = nullptr;
+    channel.b().ep().add("text",
+                         [&](const json &)
+                         {
+                             json text = std::string(4096, 't');
+                             returned = text.get_ref<const std::string &>().data();
+                             return text;
+                         });
+
+    json sum;
+    const char *received = nullptr;
+    channel.a().ep().send_request(
+        "add", json::array({40, 2}), [&](const json &r) { sum = r; }, [](const json &) {});
+    channel.a().ep().send_request(
+        "text", json(nullptr),
+        [&](const json &r) { received = r.get_ref<const std::string &>().data(); },
+        [](const json &) {});
+    ASSERT(channel.pump() == 4);
+    ASSERT(sum == 42 && received == returned);
+    ASSERT(channel.pump() == 0);
+    return true;
+}
+
+TEST(inproc_channel_threads)
+{
+    // A tiny queue so most traffic goes through the backlogs
+    inproc_channel channel({}, {}, 8);
+    add_echo(channel.b().ep());
+    std::atomic<bool> done{false};
+    std::thread server(
+        [&]
+        {
+            while (!done.load())
+                channel.b().wait(std::chrono::milliseconds(10));
+        });
+
+    const int count = 20000;
+    int correct = 0;
+    int errors = 0;
+    auto &client = channel.a();
+    for (int i = 0; i < count; ++i)
+        client.ep().send_request(
+            "add", json::array({i, 1}), [&, i](const json &r) { correct += r == i + 1; },
+            [&](const json &) { ++errors; });
+    while (correct + errors < count)
+        client.wait();
+    done = true;
+    server.join();
+    ASSERT(correct == count && errors == 0 && client.backlog() == 0);
+    return true;
+}
+
+TEST(unix_transport_fd_passing)
+{
+    std::string path = "/tmp/jsonrpc-test-" + std::to_string(::getpid()) + ".sock";
+    unix_listener listener(path);
+    const std::size_t blob_size = 8 * 1024 * 1024;
+    bool server_clean = false;
+    std::thread serving(
+        [&]
+        {
+            unix_transport server(listener.accept());
+            add_echo(server.ep());
+            // Large result out of band: a sealed memfd filled in place
+            server.ep().add("dump",
+                            [&](const json &)
+                            {
+                                auto fill = [&](char *dst) { std::memset(dst, 'b', blob_size); };
+                                auto data = server.attach_blob(blob_size, fill);
+                                return json{{"rows", 1}, {"data", data}};
+                            });
+            // And a descriptor coming in with a request
+            server.ep().add("measure",
+                            [&](const json &params)
+                            {
+                                int fd = server.take_fd(params[0]);
+                                if (fd < 0)
+                                    return json(-1);
+                                std::size_t size = mapped_blob(fd).view().size();
+                                ::close(fd);
+                                return json(size);
+                            });
+            server_clean = server.run();
+        });
+
+    unix_transport client(unix_transport::connect(path));
+    json sum;
+    bool blob_ok = false;
+    json measured;
+    int replies = 0;
+    auto done = [&]
+    {
+        if (++replies == 3)
+            client.shutdown();
+    };
+    client.ep().send_request(
+        "add", json::array({2, 3}), [&](const json &r) { sum = r; done(); },
+        [&](const json &) { done(); });
+    client.ep().send_request(
+        "dump", json(nullptr),
+        [&](const json &r)
+        {
+            int fd = client.take_fd(r["data"]);
+            if (fd >= 0)
+            {
+                mapped_blob blob(fd);
+                blob_ok = r["data"]["size"] == blob_size && blob.size() == blob_size &&
+                          std::all_of(blob.data(), blob.data() + blob.size(),
+                                      [](char c) { return c == 'b'; });
+                ::close(fd);
+            }
+            done();
+        },
+        [&](const json &) { done(); });
+    client.ep().send_request(
+        "measure", json::array({client.attach_blob("twelve bytes")}),
+        [&](const json &r) { measured = r; done(); }, [&](const json &) { done(); });
+    ASSERT(client.run()); // ends when the server closes after our shutdown
+    serving.join();
+    ASSERT(server_clean);
+    ASSERT(sum == 5 && blob_ok && measured == 12);
+    return true;
+}
+
+// ============================================================================
+// Main Test Runner
+// ============================================================================
+
+int run_transport_tests()
+{
+    int passed = 0;
+    int failed = 0;
+
+    std::cout << "\n═══════════════════════════════════════════════════════════\n";
+    std::cout << "  JSON-RPC 2.0 Transport Tests\n";
+    std::cout << "═══════════════════════════════════════════════════════════\n\n";
+
+    std::cout << "Framing Tests:\n";
+    RUN_TEST(ndjson_codec_framing);
+    RUN_TEST(ndjson_newline_scan);
+    RUN_TEST(content_length_codec_framing);
+    RUN_TEST(http_parser_framing);
+    RUN_TEST(websocket_framing);
+
+    std::cout << "\nTCP Server Tests:\n";
+    RUN_TEST(tcp_server_round_trip);
+    RUN_TEST(tcp_server_reactors);
+    RUN_TEST(tcp_server_timeouts_and_batching);
+    RUN_TEST(tcp_server_backpressure);
+
+    std::cout << "\nHTTP Transport Tests:\n";
+    RUN_TEST(http_codec_exchanges);
+    RUN_TEST(http_server_pipelining);
+    RUN_TEST(http_client_status_errors);
+
+    std::cout << "\nWebSocket Transport Tests:\n";
+    RUN_TEST(websocket_server_round_trip);
+
+    std::cout << "\nStdio Transport Tests:\n";
+    RUN_TEST(stdio_transport_pipes);
+
+    std::cout << "\nShared Memory Transport Tests:\n";
+    RUN_TEST(shm_transport_round_trip);
+
+    std::cout << "\nIn-Process Channel Tests:\n";
+    RUN_TEST(inproc_channel_pump);
+    RUN_TEST(inproc_channel_threads);
+
+    std::cout << "\nUnix Socket Transport Tests:\n";
+    RUN_TEST(unix_transport_fd_passing);
+
+    std::cout << "\n  Passed: " << passed << "\n";
+    std::cout << "  Failed: " << failed << "\n";
+    return (failed == 0) ? 0 : 1;
+}
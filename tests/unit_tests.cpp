@@ -6,10 +6,17 @@
  */
 
 #include "../include/jsonrpc.hpp"
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <coroutine>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace pooriayousefi;
@@ -378,6 +385,447 @@ TEST(dispatcher_all_notifications_batch)
     return true;
 }
 
+TEST(dispatcher_raw_single)
+{
+    dispatcher d;
+    d.add("add",
+          [](const json &params) -> json { return params[0].get<int>() + params[1].get<int>(); });
+
+    auto resp = d.handle_raw(R"({"params":[5,3],"id":"a","method":"add","jsonrpc":"2.0"})");
+    ASSERT(resp.has_value());
+    ASSERT((*resp)["result"] == 8);
+    ASSERT((*resp)["id"] == "a");
+
+    // Unknown members and nested objects are skipped
+    resp = d.handle_raw(
+        R"({"jsonrpc":"2.0","meta":{"id":9,"method":"x"},"method":"add","params":[1,1],"id":7})");
+    ASSERT(resp.has_value());
+    ASSERT((*resp)["result"] == 2);
+    ASSERT((*resp)["id"] == 7);
+
+    // Notifications produce no response
+    ASSERT(!d.handle_raw(R"({"jsonrpc":"2.0","method":"add","params":[1,2]})").has_value());
+    return true;
+}
+
+TEST(dispatcher_raw_errors)
+{
+    dispatcher d;
+    d.add("echo", [](const json &params) -> json { return params; });
+
+    auto resp = d.handle_raw(R"({"jsonrpc":"2.0","method":"echo",)");
+    ASSERT(resp.has_value());
+    ASSERT((*resp)["error"]["code"] == -32700);
+
+    resp = d.handle_raw(R"({"jsonrpc":"1.0","method":"echo","id":1})");
+    ASSERT((*resp)["error"]["code"] == -32600);
+    ASSERT((*resp)["id"].is_null());
+
+    resp = d.handle_raw(R"({"jsonrpc":"2.0","method":"echo","id":1.5})");
+    ASSERT((*resp)["error"]["code"] == -32600);
+
+    resp = d.handle_raw(R"({"jsonrpc":"2.0","method":"echo","params":"x","id":1})");
+    ASSERT((*resp)["error"]["code"] == -32600);
+
+    resp = d.handle_raw(R"({"jsonrpc":"2.0","method":"missing","params":{"a":[1]},"id":3})");
+    ASSERT((*resp)["error"]["code"] == -32601);
+    ASSERT((*resp)["id"] == 3);
+    return true;
+}
+
+TEST(dispatcher_raw_batch)
+{
+    dispatcher d;
+    d.add("echo", [](const json &params) -> json { return params; });
+
+    auto resp = d.handle_raw(R"([{"jsonrpc":"2.0","method":"echo","params":[1],"id":1},
+                                 {"jsonrpc":"2.0","method":"echo","params":[2]},
+                                 42,
+                                 {"jsonrpc":"2.0","method":"echo","params":{"k":[3]},"id":2}])");
+    ASSERT(resp.has_value());
+    ASSERT(resp->is_array());
+    ASSERT(resp->size() == 3);
+    ASSERT((*resp)[0]["result"][0] == 1);
+    ASSERT((*resp)[1]["error"]["code"] == -32600);
+    ASSERT((*resp)[2]["result"]["k"][0] == 3);
+
+    // Members are scanned in one pass: keys after nested params still land on their member
+    resp = d.handle_raw(R"([[{"id":9}],
+                           {"params":{"id":8},"jsonrpc":"2.0","method":"echo","id":"a"},
+                           {"jsonrpc":"1.0","method":"echo","id":3}])");
+    ASSERT(resp->size() == 3);
+    ASSERT((*resp)[0]["error"]["code"] == -32600);
+    ASSERT((*resp)[0]["id"].is_null());
+    ASSERT((*resp)[1]["id"] == "a");
+    ASSERT((*resp)[1]["result"]["id"] == 8);
+    ASSERT((*resp)[2]["error"]["code"] == -32600);
+
+    resp = d.handle_raw("[]");
+    ASSERT((*resp)["error"]["code"] == -32600);
+    return true;
+}
+
+TEST(dispatcher_lazy_params)
+{
+    dispatcher d;
+    std::string forwarded;
+    bool was_parsed = true;
+    d.add_lazy("forward",
+               [&](const lazy_params &params) -> json
+               {
+                   was_parsed = params.is_parsed();
+                   forwarded = std::string(params.raw());
+                   return nullptr;
+               });
+    d.add_lazy("sum",
+               [](const lazy_params &params) -> json
+               {
+                   auto v = params.as<std::vector<int>>();
+                   return v[0] + v[1];
+               });
+
+    // Raw path: params bytes are handed over untouched
+    d.handle_raw(R"({"jsonrpc":"2.0","method":"forward","params":{"a": [1, 2]}})");
+    ASSERT(!was_parsed);
+    ASSERT(forwarded == R"({"a": [1, 2]})");
+
+    // DOM path: already-parsed params are reused
+    d.handle_single(make_notification("forward", json{{"b", 1}}));
+    ASSERT(was_parsed);
+    ASSERT(json::parse(forwarded)["b"] == 1);
+
+    auto resp = d.handle_raw(R"({"jsonrpc":"2.0","method":"sum","params":[2,3],"id":1})");
+    ASSERT((*resp)["result"] == 5);
+
+    resp = d.handle_raw(R"({"jsonrpc":"2.0","method":"sum","params":{"x":1},"id":2})");
+    ASSERT((*resp)["error"]["code"] == -32602);
+
+    // Copies and moves outlive the source: parsed and serialized values are their own
+    std::string text = "[1, 2]";
+    auto parsed_copy = std::make_unique<lazy_params>(std::string_view(text));
+    parsed_copy->get();
+    lazy_params copy = *parsed_copy;
+    parsed_copy.reset();
+    ASSERT(copy.get()[1] == 2);
+
+    json dom = json::array({3});
+    auto dumped = std::make_unique<lazy_params>(lazy_params(dom));
+    dumped->raw();
+    dom = nullptr;
+    lazy_params moved = std::move(*dumped);
+    dumped.reset();
+    ASSERT(moved.raw() == "[3]");
+    return true;
+}
+
+TEST(dispatcher_params_in_place)
+{
+    dispatcher d;
+    const json *seen = nullptr;
+    d.add("peek",
+          [&seen](const json &params) -> json
+          {
+              seen = &params;
+              return params.size();
+          });
+
+    json req = make_request(std::string("big"), "peek", json::array({1, 2, 3}));
+    const json *where = &req["params"];
+
+    auto resp = d.handle_single(req);
+    ASSERT(seen == where); // no copy on the const path either
+    ASSERT((*resp)["result"] == 3);
+
+    resp = d.handle_single(std::move(req));
+    ASSERT(seen == where);
+    ASSERT((*resp)["id"] == "big");
+    ASSERT((*resp)["result"] == 3);
+
+    json batch = json::array({make_request(1, "peek", json::array({1})),
+                              make_notification("peek", json::array({1, 2})),
+                              make_request(2, "nope", json::array())});
+    resp = d.handle(std::move(batch));
+    ASSERT(resp->size() == 2);
+    ASSERT((*resp)[0]["result"] == 1);
+    ASSERT((*resp)[1]["error"]["code"] == -32601);
+    ASSERT((*resp)[1]["id"] == 2);
+    return true;
+}
+
+TEST(dispatcher_method_interning)
+{
+    dispatcher d;
+    auto reserved = d.intern("later");
+    ASSERT(d.intern("later") == reserved);
+    ASSERT(!d.find("later").has_value()); // interned but no handler yet
+
+    d.add("later", [](const json &) -> json { return 1; });
+    std::string_view name = "later";
+    ASSERT(d.find(name) == reserved);
+    ASSERT(d.contains(name));
+    ASSERT(!d.contains("other"));
+
+    // Re-registering replaces the handler and keeps the id
+    d.add("later", [](const json &) -> json { return 2; });
+    ASSERT(d.find("later") == reserved);
+    auto resp = d.handle_raw(R"({"jsonrpc":"2.0","method":"later","id":1})");
+    ASSERT((*resp)["result"] == 2);
+    return true;
+}
+
+TEST(dispatcher_freeze)
+{
+    dispatcher d;
+    for (int i = 0; i < 300; ++i)
+    {
+        d.add("svc/method_" + std::to_string(i), [i](const json &) -> json { return i; });
+    }
+    d.intern("reserved"); // interned without a handler: not part of the frozen set
+    d.freeze();
+    ASSERT(d.is_frozen());
+
+    for (int i = 0; i < 300; ++i)
+    {
+        std::string name = "svc/method_" + std::to_string(i);
+        ASSERT(d.contains(name));
+        auto resp = d.handle_single(make_request(i, name, json::array()));
+        ASSERT((*resp)["result"] == i);
+    }
+    ASSERT(!d.contains("svc/method_300"));
+    ASSERT(!d.contains("reserved"));
+    ASSERT(!d.contains(""));
+
+    auto resp = d.handle_raw(R"({"jsonrpc":"2.0","method":"svc/method_42","id":1})");
+    ASSERT((*resp)["result"] == 42);
+
+    // Replacing a registered handler is allowed, adding a new method is not
+    d.add("svc/method_1", [](const json &) -> json { return "replaced"; });
+    ASSERT((*d.handle_single(make_request(1, "svc/method_1")))["result"] == "replaced");
+    bool threw = false;
+    try
+    {
+        d.add("new_method", [](const json &) -> json { return nullptr; });
+    }
+    catch (const std::logic_error &)
+    {
+        threw = true;
+    }
+    ASSERT(threw);
+
+    // The table owns its keys, so it survives the dispatcher being moved
+    dispatcher moved = std::move(d);
+    ASSERT(moved.is_frozen());
+    ASSERT((*moved.handle_single(make_request(1, "svc/method_7")))["result"] == 7);
+    return true;
+}
+
+static int static_add(std::vector<int> v) { return v[0] + v[1]; }
+static json static_echo(const json &params) { return params; }
+static std::string static_version() { return "1.0"; }
+static void static_log(const lazy_params &) {}
+
+TEST(static_dispatcher_routing)
+{
+    static_dispatcher<method<"add", &static_add>, method<"echo", &static_echo>,
+                      method<"version", &static_version>, method<"log", &static_log>>
+        d;
+    static_assert(decltype(d)::size() == 4);
+    ASSERT(d.contains("add") && d.contains("echo") && d.contains("version"));
+    ASSERT(!d.contains("ad") && !d.contains("adds") && !d.contains(""));
+
+    auto resp = d.handle_single(make_request(1, "add", json::array({2, 3})));
+    ASSERT((*resp)["result"] == 5);
+    resp = d.handle_raw(R"({"jsonrpc":"2.0","method":"echo","params":{"x":1},"id":"e"})");
+    ASSERT((*resp)["result"]["x"] == 1);
+    ASSERT((*resp)["id"] == "e");
+    resp = d.handle_single(make_request(2, "version"));
+    ASSERT((*resp)["result"] == "1.0");
+    resp = d.handle_single(make_request(3, "log", json::object()));
+    ASSERT((*resp)["result"].is_null());
+
+    resp = d.handle_single(make_request(4, "add", json::object({{"a", 1}})));
+    ASSERT((*resp)["error"]["code"] == -32602);
+    resp = d.handle_single(make_request(5, "nope"));
+    ASSERT((*resp)["error"]["code"] == -32601);
+    return true;
+}
+
+TEST(dispatcher_parallel_batch)
+{
+    dispatcher d;
+    std::atomic<int> calls{0};
+    d.add("square",
+          [&calls](const json &params) -> json
+          {
+              ++calls;
+              int x = params[0];
+              return x * x;
+          });
+    d.add("notify",
+          [&calls](const json &) -> json
+          {
+              ++calls;
+              return nullptr;
+          });
+
+    json batch = json::array();
+    for (int i = 0; i < 500; ++i)
+    {
+        if (i % 10 == 9)
+            batch.push_back(make_notification("notify"));
+        else
+            batch.push_back(make_request(i, "square", json::array({i})));
+    }
+
+    thread_pool pool(3);
+    auto ordered = d.handle(batch, pool);
+    ASSERT(ordered && ordered->is_array() && ordered->size() == 450);
+    ASSERT(calls == 500);
+    int prev = -1;
+    for (const auto &r : *ordered)
+    {
+        int id = r["id"];
+        ASSERT(id > prev && r["result"] == id * id);
+        prev = id;
+    }
+
+    // Completion order: same responses, any order
+    auto unordered = d.handle(json(batch), pool, batch_order::completion);
+    ASSERT(unordered && unordered->size() == 450);
+    std::vector<bool> seen(500, false);
+    for (const auto &r : *unordered)
+        seen[r["id"].get<int>()] = true;
+    for (int i = 0; i < 500; ++i)
+        ASSERT(seen[i] == (i % 10 != 9));
+
+    // Serialized input takes the same path
+    auto raw = d.handle_raw(batch.dump(), pool);
+    ASSERT(raw && *raw == *ordered);
+
+    // Batches made only of notifications produce no response
+    auto none = d.handle(json::array({make_notification("notify"), make_notification("notify")}),
+                         pool);
+    ASSERT(!none);
+    return true;
+}
+
+TEST(concurrent_dispatcher_reload)
+{
+    concurrent_dispatcher d;
+    auto resp = d.handle_single(make_request(1, "version"));
+    ASSERT((*resp)["error"]["code"] == -32601);
+
+    d.add("version", [](const json &) -> json { return 1; });
+    ASSERT(d.contains("version"));
+
+    // Readers keep dispatching while the method is replaced; every call sees some version
+    std::atomic<bool> stop{false};
+    std::atomic<int> bad{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t)
+    {
+        readers.emplace_back(
+            [&]
+            {
+                while (!stop)
+                {
+                    auto r = d.handle_raw(R"({"jsonrpc":"2.0","method":"version","id":7})");
+                    if (!r || !(*r)["result"].is_number_integer())
+                        ++bad;
+                }
+            });
+    }
+    for (int v = 2; v <= 50; ++v)
+        d.add("version", [v](const json &) -> json { return v; });
+    stop = true;
+    for (auto &t : readers)
+        t.join();
+    ASSERT(bad == 0);
+    ASSERT((*d.handle_single(make_request(2, "version")))["result"] == 50);
+
+    // Several changes land in one snapshot
+    concurrent_dispatcher::batch b;
+    b.add("a", [](const json &) -> json { return "a"; });
+    b.add("b", [](const json &) -> json { return "b"; });
+    b.remove("version");
+    d.apply(std::move(b));
+    ASSERT(d.contains("a") && d.contains("b") && !d.contains("version"));
+    ASSERT(d.remove("a"));
+    ASSERT(!d.remove("a"));
+
+    // A handler may register methods; reclamation is deferred instead of waiting on itself
+    d.add("install",
+          [&d](const json &) -> json
+          {
+              d.add("installed", [](const json &) -> json { return true; });
+              return "ok";
+          });
+    ASSERT((*d.handle_single(make_request(3, "install")))["result"] == "ok");
+    ASSERT((*d.handle_single(make_request(4, "installed")))["result"] == true);
+
+    // A handler of one dispatcher is not a reader of another: a removal it makes there is
+    // reclaimed right away, dropping the old handler
+    auto token = std::make_shared<int>(0);
+    std::weak_ptr<int> watch = token;
+    concurrent_dispatcher::batch initial;
+    initial.add("held", [token](const json &) -> json { return *token; });
+    initial.add_typed<std::vector<int>, int>("sum", [](std::vector<int> v)
+                                             { return std::accumulate(v.begin(), v.end(), 0); });
+    concurrent_dispatcher other(std::move(initial));
+    token.reset();
+    ASSERT(other.contains("held") && !watch.expired());
+    ASSERT((*other.handle_single(make_request(5, "sum", json::array({1, 2}))))["result"] == 3);
+    d.add("unload",
+          [&other](const json &) -> json
+          {
+              other.remove("held");
+              return "ok";
+          });
+    ASSERT((*d.handle_single(make_request(6, "unload")))["result"] == "ok");
+    ASSERT(!other.contains("held") && watch.expired());
+    return true;
+}
+
+TEST(unique_function_storage)
+{
+    // Move-only captures are accepted and small callables live inline
+    auto owned = std::make_unique<int>(7);
+    unique_function<int(int)> f = [p = std::move(owned)](int x) { return *p + x; };
+    ASSERT(f);
+    ASSERT(f(1) == 8);
+    unique_function<int(int)> g = std::move(f);
+    ASSERT(!f);
+    ASSERT(g(2) == 9);
+
+    // Large callables fall back to the heap and still move cleanly
+    std::array<char, 256> big{};
+    big[0] = 'x';
+    unique_function<char()> h = [big] { return big[0]; };
+    unique_function<char()> h2;
+    h2 = std::move(h);
+    ASSERT(!h && h2() == 'x');
+
+    // Mutable state persists across calls
+    unique_function<int()> counter = [n = 0]() mutable { return ++n; };
+    counter();
+    ASSERT(counter() == 2);
+
+    // Empty std::function and null pointers produce an empty wrapper
+    unique_function<void()> empty = std::function<void()>();
+    ASSERT(!empty);
+    unique_function<void()> null_ptr = static_cast<void (*)()>(nullptr);
+    ASSERT(!null_ptr);
+
+    int calls = 0;
+    auto bump = [&calls](int by) { calls += by; };
+    function_ref<void(int)> ref = bump;
+    ASSERT(ref);
+    ref(3);
+    ASSERT(calls == 3);
+    ASSERT(!function_ref<void()>());
+    return true;
+}
+
 // ============================================================================
 // Endpoint Tests
 // ============================================================================
@@ -470,6 +918,355 @@ TEST(endpoint_progress)
     return true;
 }
 
+// Awaitable that parks the coroutine until the test resumes it
+struct parked
+{
+    std::vector<std::coroutine_handle<>> *queue;
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> h) const { queue->push_back(h); }
+    void await_resume() const {}
+};
+
+static void resume_all(std::vector<std::coroutine_handle<>> &queue)
+{
+    auto ready = std::move(queue);
+    queue.clear();
+    for (auto h : ready)
+        h.resume();
+}
+
+TEST(endpoint_async_handlers)
+{
+    std::vector<json> sent;
+    std::vector<std::coroutine_handle<>> queue;
+    endpoint ep([&sent](const json &msg) { sent.push_back(msg); });
+
+    auto twice = [&queue](int x) -> task<int>
+    {
+        co_await parked{&queue};
+        co_return x * 2;
+    };
+    ep.add_async("slow_double",
+                 [&](const json &params) -> task<json>
+                 {
+                     int doubled = co_await twice(params[0].get<int>());
+                     // Context survives the suspension
+                     report_progress(json{{"id", current_context()->id}});
+                     if (is_canceled())
+                         throw_rpc_error(request_cancelled);
+                     co_return doubled;
+                 });
+    ep.add("fast", [](const json &) -> json { return "fast"; });
+
+    ep.receive(make_request(1, "slow_double", json::array({21})));
+    ASSERT(sent.empty());
+    ASSERT(current_context() == nullptr);
+    resume_all(queue);
+    ASSERT(sent.size() == 2);
+    ASSERT(sent[0]["method"] == "$/progress" && sent[0]["params"]["value"]["id"] == 1);
+    ASSERT(sent[1]["id"] == 1 && sent[1]["result"] == 42);
+    ASSERT(current_context() == nullptr);
+
+    // Cancellation requested while suspended is seen after resuming
+    sent.clear();
+    ep.receive(make_request(2, "slow_double", json::array({1})));
+    ep.receive(make_notification("$/cancelRequest", json{{"id", 2}}));
+    resume_all(queue);
+    ASSERT(sent.back()["error"]["code"] == request_cancelled.code);
+
+    // Batch responses wait for async members
+    sent.clear();
+    ep.receive(json::array({make_request(3, "slow_double", json::array({5})),
+                            make_request(4, "fast")}));
+    ASSERT(sent.empty());
+    resume_all(queue);
+    ASSERT(sent.size() == 2 && sent[1].is_array() && sent[1].size() == 2);
+    ASSERT(sent[1][0]["id"] == 4 && sent[1][1]["result"] == 10);
+
+    // A handler that throws before handing back its awaitable is answered right away
+    auto later = [&queue](json v) -> task<json>
+    {
+        co_await parked{&queue};
+        co_return v;
+    };
+    ep.add_async("checked",
+                 [&later](const json &params) -> task<json>
+                 {
+                     if (!params.is_array() || params.empty())
+                         throw_rpc_error(invalid_params);
+                     if (params[0] == "boom")
+                         throw std::runtime_error("boom");
+                     return later(params[0]);
+                 });
+    sent.clear();
+    ep.receive(make_request(5, "checked", json::object()));
+    ep.receive(make_request(6, "checked", json::array({"boom"})));
+    ASSERT(sent.size() == 2 && queue.empty());
+    ASSERT(sent[0]["id"] == 5 && sent[0]["error"]["code"] == invalid_params.code);
+    ASSERT(sent[1]["id"] == 6 && sent[1]["error"]["code"] == internal_error.code);
+
+    // ... also inside a batch, whose reply still waits only for the suspended members
+    sent.clear();
+    ep.receive(json::array({make_request(7, "checked", json::object()),
+                            make_request(8, "checked", json::array({8}))}));
+    ASSERT(sent.empty());
+    resume_all(queue);
+    ASSERT(sent.size() == 1 && sent[0].size() == 2);
+    ASSERT(sent[0][0]["id"] == 7 && sent[0][0]["error"]["code"] == invalid_params.code);
+    ASSERT(sent[0][1]["id"] == 8 && sent[0][1]["result"] == 8);
+    ep.receive(json::array({make_request(9, "checked", json::object())}));
+    ASSERT(sent.size() == 2 && sent[1][0]["id"] == 9);
+    return true;
+}
+
+TEST(endpoint_coroutine_calls)
+{
+    // Client and server wired back to back: responses arrive while the call is suspending
+    endpoint *client_ptr = nullptr;
+    endpoint server([&client_ptr](const json &msg) { client_ptr->receive(msg); });
+    endpoint client([&server](const json &msg) { server.receive(msg); });
+    client_ptr = &client;
+    server.add_typed<std::vector<int>, int>("sum", [](std::vector<int> v)
+                                           { return std::accumulate(v.begin(), v.end(), 0); });
+    server.add("fail", [](const json &) -> json { throw_rpc_error({42, "nope"}); });
+
+    std::vector<std::string> log;
+    auto client_calls = [&]() -> task<void>
+    {
+        std::vector<int> nums{1, 2, 3};
+        int a = co_await client.call<int>("sum", nums);
+        json pair = json::array({a, 4}); // built outside co_await (g++ 12 init-list bug)
+        json b = co_await client.call("sum", pair);
+        log.push_back(std::to_string(a) + "," + b.dump());
+        try
+        {
+            co_await client.call<void>("fail");
+        }
+        catch (const rpc_exception &ex)
+        {
+            log.push_back(std::to_string(ex.err.code) + ":" + ex.err.message);
+        }
+    };
+    spawn(client_calls());
+    ASSERT(log.size() == 2);
+    ASSERT(log[0] == "6,10");
+    ASSERT(log[1] == "42:nope");
+
+    // Inline responses don't resume the caller from inside the send: no stack growth
+    const int inline_calls = 100000;
+    int total = 0;
+    auto many_calls = [&]() -> task<void>
+    {
+        std::vector<int> terms{0, 1};
+        for (int i = 0; i < inline_calls; ++i)
+            total += co_await client.call<int>("sum", terms);
+    };
+    spawn(many_calls());
+    ASSERT(total == inline_calls);
+
+    // A send that throws after the response came inline: the caller gets the exception
+    endpoint *flaky_ptr = nullptr;
+    endpoint flaky(
+        [&flaky_ptr](const json &msg)
+        {
+            flaky_ptr->receive(make_result(msg["id"], 1));
+            throw std::runtime_error("link down");
+        });
+    flaky_ptr = &flaky;
+    std::string failure;
+    auto flaky_call = [&]() -> task<void>
+    {
+        try
+        {
+            co_await flaky.call<int>("m");
+        }
+        catch (const std::runtime_error &ex)
+        {
+            failure = ex.what();
+        }
+    };
+    spawn(flaky_call());
+    ASSERT(failure == "link down");
+
+    // A call whose response never comes resumes on cancel()
+    std::vector<json> sent;
+    endpoint lonely([&sent](const json &msg) { sent.push_back(msg); });
+    auto op = lonely.call<int>("never");
+    bool cancelled = false;
+    // Named: the coroutine is resumed after this statement and still uses the captures
+    auto await_op = [&]() -> task<void>
+    {
+        try
+        {
+            co_await op;
+        }
+        catch (const rpc_exception &ex)
+        {
+            cancelled = ex.err.code == request_cancelled.code;
+        }
+    };
+    spawn(await_op());
+    ASSERT(sent.size() == 1 && sent[0]["id"] == op.id());
+    ASSERT(!cancelled);
+    lonely.cancel(op.id());
+    ASSERT(cancelled);
+    ASSERT(sent.back()["method"] == "$/cancelRequest");
+    // The late response is ignored
+    lonely.receive(make_result(op.id(), 1));
+    return true;
+}
+
+TEST(endpoint_numeric_ids)
+{
+    std::vector<json> sent;
+    endpoint ep([&sent](const json &msg) { sent.push_back(msg); }, endpoint_options{true});
+
+    std::vector<int> results;
+    auto on_ok = [&results](const json &r) { results.push_back(r.get<int>()); };
+    auto first = ep.send_request("m", json::array(), on_ok, nullptr);
+    ASSERT(first == "1");
+    ASSERT(sent[0]["id"] == 1);
+
+    // The first request stays outstanding while ids of many others wrap around the table
+    for (int i = 0; i < 1000; ++i)
+    {
+        ep.send_request("m", json::array(), on_ok, nullptr);
+        ep.receive(make_result(sent.back()["id"], i));
+    }
+    ASSERT(results.size() == 1000 && results.back() == 999);
+    ep.receive(make_result(1, -1));
+    ASSERT(results.back() == -1);
+
+    // Unknown, late and string ids are ignored
+    ep.receive(make_result(1, -2));
+    ep.receive(make_result("1", -3));
+    ep.receive(make_result(99999, -4));
+    ASSERT(results.size() == 1001);
+
+    int value = 0;
+    // Named: receive() below resumes the coroutine, which still uses the captures
+    auto call_m = [&]() -> task<void>
+    {
+        value = co_await ep.call<int>("m");
+    };
+    spawn(call_m());
+    ASSERT(sent.back()["id"] == 1002);
+    ep.receive(make_result(1002, 7));
+    ASSERT(value == 7);
+    return true;
+}
+
+TEST(timer_wheel_deadlines)
+{
+    using namespace std::chrono_literals;
+    auto start = endpoint::clock::now();
+    detail::timer_wheel<int> wheel(1ms, start);
+    std::vector<int> fired;
+    auto record = [&fired](int v) { fired.push_back(v); };
+
+    // A deadline between ticks fires on the tick after it, never the one before
+    wheel.schedule(start + 1500us, 1);
+    wheel.schedule(start + 2ms, 2);
+    wheel.advance(start + 1ms, record);
+    ASSERT(fired.empty());
+    wheel.advance(start + 1999us, record);
+    ASSERT(fired.empty());
+    wheel.advance(start + 2ms, record);
+    ASSERT(fired.size() == 2 && fired[0] + fired[1] == 3);
+    return true;
+}
+
+TEST(endpoint_request_timeouts)
+{
+    using namespace std::chrono_literals;
+    std::vector<json> sent;
+    endpoint_options options;
+    options.default_timeout = 100ms;
+    endpoint ep([&sent](const json &msg) { sent.push_back(msg); }, options);
+    auto now = endpoint::clock::now();
+
+    std::vector<int> errors;
+    auto on_err = [&errors](const json &e) { errors.push_back(e["code"].get<int>()); };
+    ep.send_request("slow", json::array(), nullptr, on_err);         // default 100ms
+    ep.send_request("quick", json::array(), nullptr, on_err, 20ms);  // own deadline
+    ep.send_request("forever", json::array(), nullptr, on_err, 0ms); // no deadline
+    auto answered = ep.send_request("answered", json::array(), nullptr, on_err);
+    ep.receive(make_result(answered, true)); // response cancels its timer
+    ASSERT(ep.pending_count() == 3);
+
+    ASSERT(ep.poll(now) == 0);
+    ASSERT(ep.poll(now + 50ms) == 1);
+    ASSERT(errors.size() == 1 && errors[0] == request_timeout.code);
+    ASSERT(ep.poll(now + 500ms) == 1);
+    ASSERT(errors.size() == 2);
+    ASSERT(ep.pending_count() == 1);
+
+    // A late response for an expired request is ignored
+    ep.receive(make_result(sent[0]["id"], 1));
+    ASSERT(errors.size() == 2);
+
+    // Coroutine calls resume with request_timeout
+    int code = 0;
+    // Named: poll() below resumes the coroutine, which still uses the captures
+    auto call_slow = [&]() -> task<void>
+    {
+        try
+        {
+            co_await ep.call<int>("slow", json::array(), 10ms);
+        }
+        catch (const rpc_exception &ex)
+        {
+            code = ex.err.code;
+        }
+    };
+    spawn(call_slow());
+    ep.poll(endpoint::clock::now() + 1s);
+    ASSERT(code == request_timeout.code);
+    return true;
+}
+
+TEST(endpoint_request_batching)
+{
+    using namespace std::chrono_literals;
+    std::vector<json> sent;
+    endpoint_options options;
+    options.batching = true;
+    options.batch_window = 5ms;
+    options.batch_max_messages = 3;
+    endpoint ep([&sent](const json &msg) { sent.push_back(msg); }, options);
+
+    std::vector<int> results;
+    auto on_ok = [&results](const json &r) { results.push_back(r.get<int>()); };
+    auto a = ep.send_request("a", json::array(), on_ok, nullptr);
+    ep.send_notification("note");
+    ASSERT(sent.empty());
+    auto b = ep.send_request("b", json::array(), on_ok, nullptr); // reaches max_messages
+    ASSERT(sent.size() == 1 && sent[0].is_array() && sent[0].size() == 3);
+    ASSERT(sent[0][2]["method"] == "b");
+
+    // Responses come back as one array and are routed per id
+    ep.receive(json::array({make_result(b, 2), make_result(a, 1)}));
+    ASSERT((results == std::vector<int>{2, 1}));
+    ASSERT(sent.size() == 1); // nothing answered back
+
+    // A lone queued message is sent as-is once the window passes
+    ep.send_notification("later");
+    ASSERT(ep.poll(endpoint::clock::now()) == 0 && sent.size() == 1);
+    ep.poll(endpoint::clock::now() + 10ms);
+    ASSERT(sent.size() == 2 && sent[1]["method"] == "later");
+
+    // Byte limit
+    endpoint_options by_size = options;
+    by_size.batch_max_messages = 100;
+    by_size.batch_max_bytes = 120;
+    endpoint small([&sent](const json &msg) { sent.push_back(msg); }, by_size);
+    small.send_notification("n", json::array({std::string(50, 'x')}));
+    ASSERT(sent.size() == 2);
+    small.send_notification("n", json::array({std::string(50, 'y')}));
+    ASSERT(sent.size() == 3 && sent[2].size() == 2);
+    return true;
+}
+
 TEST(endpoint_response_callback)
 {
     endpoint ep([](const json &) {});
@@ -495,6 +1292,101 @@ TEST(endpoint_response_callback)
     return true;
 }
 
+TEST(message_writer_responses)
+{
+    message_writer writer;
+    std::string out = "prefix";
+    writer.write(out, response_parts{7, json{{"sum", 3}}, std::nullopt});
+    ASSERT(out == R"(prefix{"jsonrpc":"2.0","id":7,"result":{"sum":3}})");
+
+    // Appends; strings are escaped like dump() does
+    writer.write(out, response_parts{"a\"b", {}, method_not_found});
+    auto second = json::parse(out.substr(out.find('}', out.find("sum")) + 2));
+    ASSERT(second == make_error("a\"b", method_not_found));
+
+    out.clear();
+    json msg = make_request(1, "echo", json::array({"x\n", 1.5, nullptr}));
+    writer.write(out, msg);
+    ASSERT(out == msg.dump());
+
+    // to_json() builds the same message
+    response_parts result{1, 2, std::nullopt};
+    response_parts failure{nullptr, {}, parse_error};
+    ASSERT(std::move(result).to_json() == make_result(1, 2));
+    ASSERT(std::move(failure).to_json() == make_error(nullptr, parse_error));
+    return true;
+}
+
+TEST(endpoint_response_sender)
+{
+    std::vector<json> sent;
+    std::vector<std::string> written;
+    endpoint ep([&](json &&msg) { sent.push_back(std::move(msg)); });
+    message_writer writer;
+    ep.set_response_sender(
+        [&](response_parts &&r)
+        {
+            written.emplace_back();
+            writer.write(written.back(), r);
+        });
+    ep.add("add", [](const json &p) { return p[0].get<int>() + p[1].get<int>(); });
+
+    // Single responses and errors go to the response sender
+    ep.receive_raw(R"({"jsonrpc":"2.0","method":"add","params":[1,2],"id":1})");
+    ep.receive_raw(R"({"jsonrpc":"2.0","method":"nope","id":"x"})");
+    ep.receive_raw("{bad");
+    ASSERT(written.size() == 3 && sent.empty());
+    ASSERT(written[0] == R"({"jsonrpc":"2.0","id":1,"result":3})");
+    ASSERT(json::parse(written[1])["error"]["code"] == -32601);
+    ASSERT(json::parse(written[2])["error"]["code"] == -32700);
+
+    // Batches and the endpoint's own requests still go through the send_fn
+    ep.receive_raw(R"([{"jsonrpc":"2.0","method":"add","params":[1,1],"id":2}])");
+    ep.send_notification("note");
+    ASSERT(written.size() == 3 && sent.size() == 2);
+    ASSERT(sent[0].is_array() && sent[0][0]["result"] == 2 && sent[1]["method"] == "note");
+    return true;
+}
+
+TEST(endpoint_raw_id_echo)
+{
+    std::vector<std::string> written;
+    endpoint ep([](json &&) {});
+    message_writer writer;
+    ep.set_response_sender(
+        [&](response_parts &&r)
+        {
+            written.emplace_back();
+            writer.write(written.back(), r);
+        });
+    ep.add("add", [](const json &p) { return p[0].get<int>() + p[1].get<int>(); });
+    ep.add("fail", [](const json &) -> json
+           { throw_rpc_error({-32000, "Custom \"x\"", json{{"k", 1}}}); });
+
+    // The id's bytes are copied from the request, escapes and all
+    ep.receive_raw(R"({"jsonrpc":"2.0","method":"add","params":[1,2],"id" :  "\u0061b" })");
+    ep.receive_raw(R"({"id":-42,"jsonrpc":"2.0","method":"add","params":[2,2]})");
+    ASSERT(written[0] == R"({"jsonrpc":"2.0","id":"\u0061b","result":3})");
+    ASSERT(written[1] == R"({"jsonrpc":"2.0","id":-42,"result":4})");
+
+    // Standard errors are pre-rendered; others are written member by member
+    ep.receive_raw(R"({"jsonrpc":"2.0","method":"nope","id":7})");
+    ep.receive_raw(R"({"jsonrpc":"2.0","method":"fail","id":null})");
+    ASSERT(written[2] ==
+           R"({"jsonrpc":"2.0","id":7,"error":{"code":-32601,"message":"Method not found"}})");
+    ASSERT(written[3] == R"({"jsonrpc":"2.0","id":null,"error":)"
+                         R"({"code":-32000,"message":"Custom \"x\"","data":{"k":1}}})");
+
+    // An invalid request is answered with a null id, not the one it carried
+    ep.receive_raw(R"({"jsonrpc":"1.0","method":"add","id":"raw"})");
+    ASSERT(json::parse(written[4])["id"].is_null());
+
+    // Nested ids are not the request's
+    ep.receive_raw(R"({"params":[{"id":5},1],"jsonrpc":"2.0","method":"add","id":9})");
+    ASSERT(json::parse(written[5])["id"] == 9);
+    return true;
+}
+
 // ============================================================================
 // Error Object Tests
 // ============================================================================
@@ -602,6 +1494,17 @@ int run_unit_tests()
     RUN_TEST(dispatcher_batch_requests);
     RUN_TEST(dispatcher_empty_batch);
     RUN_TEST(dispatcher_all_notifications_batch);
+    RUN_TEST(dispatcher_raw_single);
+    RUN_TEST(dispatcher_raw_errors);
+    RUN_TEST(dispatcher_raw_batch);
+    RUN_TEST(dispatcher_lazy_params);
+    RUN_TEST(dispatcher_params_in_place);
+    RUN_TEST(dispatcher_method_interning);
+    RUN_TEST(dispatcher_freeze);
+    RUN_TEST(static_dispatcher_routing);
+    RUN_TEST(dispatcher_parallel_batch);
+    RUN_TEST(concurrent_dispatcher_reload);
+    RUN_TEST(unique_function_storage);
 
     // Endpoint tests
     std::cout << "\nEndpoint Tests:\n";
@@ -612,6 +1515,15 @@ int run_unit_tests()
     RUN_TEST(endpoint_cancellation);
     RUN_TEST(endpoint_progress);
     RUN_TEST(endpoint_response_callback);
+    RUN_TEST(endpoint_async_handlers);
+    RUN_TEST(endpoint_coroutine_calls);
+    RUN_TEST(endpoint_numeric_ids);
+    RUN_TEST(timer_wheel_deadlines);
+    RUN_TEST(endpoint_request_timeouts);
+    RUN_TEST(endpoint_request_batching);
+    RUN_TEST(message_writer_responses);
+    RUN_TEST(endpoint_response_sender);
+    RUN_TEST(endpoint_raw_id_echo);
 
     // Error tests
     std::cout << "\nError Object Tests:\n";